@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -17,6 +17,23 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// Buffers are hashed by (dev, blockno) into NBUCKET buckets,
+// each with its own lock, so lookups of different blocks on
+// different CPUs do not contend.  Each bucket keeps its buffers
+// in least recently used order.  A miss recycles the least
+// recently used unused buffer of the block's own bucket, and
+// only if there is none takes one from another bucket, holding
+// one bucket lock at a time.
+//
+// Buffers come from a slab cache.  A miss allocates a new
+// buffer instead of recycling one while the cache is within
+// BCACHEPAGES of memory and memory is not low, and bshrink()
+// frees unused buffers down to NBUF when user memory runs out.
+// Buffers bypass the slab magazines, so freed buffers give
+// their pages back to kalloc() as soon as a slab empties.
+// If every buffer is in use and no new one can be allocated,
+// bget() waits for a brelse().
 
 #include "types.h"
 #include "defs.h"
@@ -25,71 +42,236 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "meminfo.h"
+#include "slab.h"
 
-struct {
+#define BUFLOW 128              // Don't grow when fewer pages are free
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf head;              // List of buffers, through prev/next
+};
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+struct {
+  struct spinlock lock;         // Protects nbuf, nwait and gen
+  struct slabcache cache;
+  uint nbuf;                    // Buffers allocated
+  uint maxbuf;                  // Buffers that fit in BCACHEPAGES
+  uint nwait;                   // bget() calls looking for a buffer
+  uint gen;                     // Bumped when a buffer becomes unused
+  uint hand;                    // Next bucket bshrink() takes from
+  struct bucket bucket[NBUCKET];
 } bcache;
 
+static struct bucket*
+bucket(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 7 + blockno) % NBUCKET];
+}
+
+static void
+bunlink(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+}
+
+// Put b at the most recently used end of bk.
+static void
+bpush(struct bucket *bk, struct buf *b)
+{
+  b->next = bk->head.next;
+  b->prev = &bk->head;
+  bk->head.next->prev = b;
+  bk->head.next = b;
+}
+
+// Put b at the least recently used end of bk.
+static void
+bappend(struct bucket *bk, struct buf *b)
+{
+  b->next = &bk->head;
+  b->prev = bk->head.prev;
+  bk->head.prev->next = b;
+  bk->head.prev = b;
+}
+
 void
 binit(void)
 {
-  struct buf *b;
+  struct bucket *bk;
 
   initlock(&bcache.lock, "bcache");
+  slabinit(&bcache.cache, "buf", sizeof(struct buf));
+  bcache.maxbuf = BCACHEPAGES * bcache.cache.perslab;
 
 //PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  // Create the empty bucket lists.
+  for(bk = bcache.bucket; bk < &bcache.bucket[NBUCKET]; bk++){
+    initlock(&bk->lock, "bcache.bucket");
+    bk->head.prev = &bk->head;
+    bk->head.next = &bk->head;
   }
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
+// Look for block blockno of dev in bucket bk, taking a
+// reference to it if it is there.  Caller holds bk->lock.
 static struct buf*
-bget(uint dev, uint blockno)
+bfind(struct bucket *bk, uint dev, uint blockno)
 {
   struct buf *b;
 
-  acquire(&bcache.lock);
-
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bk->head.next; b != &bk->head; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
       return b;
     }
   }
+  return 0;
+}
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
+// Unlink and return the least recently used buffer of bk
+// that nobody is using, or 0 if there is none.
+// Even if refcnt==0, B_DIRTY indicates a buffer is in use
+// because log.c has modified it but not yet committed it.
+// Caller holds bk->lock.
+static struct buf*
+blru(struct bucket *bk)
+{
+  struct buf *b;
+
+  for(b = bk->head.prev; b != &bk->head; b = b->prev){
+    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0){
+      bunlink(b);
+      return b;
+    }
+  }
+  return 0;
+}
+
+// Take an unused buffer from a bucket other than bk, trying
+// the buckets after it one at a time.
+static struct buf*
+bsteal(struct bucket *bk)
+{
+  struct bucket *from;
+  struct buf *b;
+  int i;
+
+  for(i = 1; i < NBUCKET; i++){
+    from = &bcache.bucket[(bk - bcache.bucket + i) % NBUCKET];
+    acquire(&from->lock);
+    b = blru(from);
+    release(&from->lock);
+    if(b)
+      return b;
+  }
+  return 0;
+}
+
+// Allocate a new buffer if the cache may grow.
+static struct buf*
+bnew(void)
+{
+  struct buf *b;
+
+  // Look before locking, so a full cache costs misses nothing.
+  if(bcache.nbuf >= bcache.maxbuf)
+    return 0;
+  if(bcache.nbuf >= NBUF && kfreepages() < BUFLOW)
+    return 0;
+  acquire(&bcache.lock);
+  if(bcache.nbuf >= bcache.maxbuf){
+    release(&bcache.lock);
+    return 0;
+  }
+  bcache.nbuf++;
+  release(&bcache.lock);
+
+  if((b = slabget(&bcache.cache)) == 0){
+    acquire(&bcache.lock);
+    bcache.nbuf--;
+    release(&bcache.lock);
+    return 0;
+  }
+  initsleeplock(&b->lock, "buffer");
+  return b;
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer, waiting for one if wait is
+// set and returning 0 otherwise.  In either case, take a
+// reference to the buffer, but do not lock it; *hit says
+// whether the block was cached.
+static struct buf*
+bref(uint dev, uint blockno, int wait, int *hit)
+{
+  struct bucket *bk;
+  struct buf *b, *spare;
+  uint gen;
+
+  bk = bucket(dev, blockno);
+  spare = 0;
+  for(;;){
+    acquire(&bk->lock);
+    if((b = bfind(bk, dev, blockno)) != 0){
+      // Another CPU added the block while we looked for a
+      // buffer elsewhere.  The spare's old block hashes to
+      // another bucket, so it can sit unused in this one.
+      if(spare){
+        spare->flags = 0;
+        bappend(bk, spare);
+      }
+      release(&bk->lock);
+      *hit = 1;
       return b;
     }
+
+    // Not cached; add a new buffer or recycle an unused one
+    // while holding bk->lock, so the block is added only once.
+    if(spare == 0 && (spare = bnew()) == 0)
+      spare = blru(bk);
+    if(spare){
+      spare->dev = dev;
+      spare->blockno = blockno;
+      spare->flags = 0;
+      spare->refcnt = 1;
+      bpush(bk, spare);
+      release(&bk->lock);
+      *hit = 0;
+      return spare;
+    }
+    release(&bk->lock);
+
+    // Nothing unused in bk.  nwait tells bput() to bump gen
+    // when a buffer becomes unused; it is set before bsteal()
+    // looks at the buckets, so a bput() of a buffer bsteal()
+    // has passed will bump it, and we won't sleep through it.
+    acquire(&bcache.lock);
+    bcache.nwait++;
+    gen = bcache.gen;
+    release(&bcache.lock);
+    spare = bsteal(bk);
+    acquire(&bcache.lock);
+    while(spare == 0 && wait && bcache.gen == gen)
+      sleep(&bcache.gen, &bcache.lock);
+    bcache.nwait--;
+    release(&bcache.lock);
+    if(spare == 0 && !wait)
+      return 0;
   }
-  panic("bget: no buffers");
+}
+
+// Return a locked buffer for block blockno of dev.
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  struct buf *b;
+  int hit;
+
+  b = bref(dev, blockno, 1, &hit);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -115,8 +297,33 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
+// Drop a reference to b.
+// An unused buffer becomes the most recently used of its bucket.
+static void
+bput(struct buf *b)
+{
+  struct bucket *bk;
+
+  // b cannot change buckets while we hold a reference.
+  bk = bucket(b->dev, b->blockno);
+  acquire(&bk->lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    // no one is waiting for it.
+    bunlink(b);
+    bpush(bk, b);
+  }
+  release(&bk->lock);
+
+  if(bcache.nwait){
+    acquire(&bcache.lock);
+    bcache.gen++;
+    wakeup(&bcache.gen);
+    release(&bcache.lock);
+  }
+}
+
 // Release a locked buffer.
-// Move to the head of the MRU list.
 void
 brelse(struct buf *b)
 {
@@ -124,19 +331,84 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
+  bput(b);
+}
 
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+// Release b once ideintr() has finished reading it ahead.
+// The reader that locked b is not the current process.
+void
+bdone(struct buf *b)
+{
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Start reading block blockno of dev into the cache, for
+// read-ahead, without waiting for the disk or for a buffer.
+// Returns 1 if the block was already cached.
+int
+breada(uint dev, uint blockno)
+{
+  struct buf *b;
+  int hit;
+
+  if((b = bref(dev, blockno, 0, &hit)) == 0)
+    return 0;
+  if(hit){
+    bput(b);
+    return 1;
+  }
+  // Someone else may have locked the new buffer first and
+  // read the block already.
+  acquiresleep(&b->lock);
+  if(b->flags & B_VALID){
+    brelse(b);
+    return 0;
   }
-  
+  ideasync(b);
+  return 0;
+}
+
+// Free unused buffers, leaving at least NBUF, until n pages
+// of memory have gone back to kalloc(), when memory runs low.
+// Returns how many pages were freed.  The buckets take turns
+// giving up their least recently used buffers, so that no
+// bucket is emptied while the others stay full.
+int
+bshrink(int n)
+{
+  struct bucket *bk;
+  struct buf *b;
+  int done, i;
+
+  done = 0;
+  for(i = 0; i < NBUCKET && done < n && bcache.nbuf > NBUF; i++){
+    // A racy hand is fine; it only spreads the work.
+    bk = &bcache.bucket[bcache.hand++ % NBUCKET];
+    acquire(&bk->lock);
+    while(done < n && (b = blru(bk)) != 0){
+      acquire(&bcache.lock);
+      if(bcache.nbuf <= NBUF){
+        release(&bcache.lock);
+        bappend(bk, b);
+        break;
+      }
+      bcache.nbuf--;
+      release(&bcache.lock);
+      done += slabput(&bcache.cache, b);
+    }
+    release(&bk->lock);
+  }
+  return done;
+}
+
+// Fill in the buffer cache size of *mi for meminfo.
+void
+bcachestat(struct meminfo *mi)
+{
+  acquire(&bcache.lock);
+  mi->nbuf = bcache.nbuf;
+  mi->bufbytes = bcache.nbuf * sizeof(struct buf);
   release(&bcache.lock);
 }
 //PAGEBREAK!
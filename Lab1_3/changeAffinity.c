@@ -0,0 +1,26 @@
+#include "types.h"
+#include "user.h"
+#include "fcntl.h"
+
+int main(int argc, char* argv[])
+{
+    int mask;
+
+    if (argc < 2)
+    {
+        printf(1 , "Not enough arguments\n");
+        exit();
+    }
+    if (argc < 3)
+    {
+        mask = get_affinity(atoi(argv[1]));
+        if (mask < 0)
+            printf(1 , "No such process\n");
+        else
+            printf(1 , "pid %s: cpu mask 0x%x\n", argv[1], mask);
+        exit();
+    }
+    if (set_affinity(atoi(argv[1]), atoi(argv[2])) < 0)
+        printf(1 , "Invalid pid or cpu mask\n");
+    exit();
+}
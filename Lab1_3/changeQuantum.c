@@ -0,0 +1,15 @@
+#include "types.h"
+#include "user.h"
+#include "fcntl.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        printf(1 , "Not enough arguments\n");
+        exit();
+    }
+    if (set_queue_quantum(atoi(argv[1]), atoi(argv[2])) < 0)
+        printf(1 , "Invalid queue or quantum\n");
+    exit();
+}
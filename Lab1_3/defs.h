@@ -2,19 +2,27 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct meminfo;
 struct pipe;
 struct proc;
 struct rtcdate;
+struct schedstat;
 struct spinlock;
 struct sleeplock;
+struct slabcache;
 struct stat;
 struct superblock;
+struct vmstat;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+int             breada(uint, uint);
+void            bdone(struct buf*);
+void            bcachestat(struct meminfo*);
+int             bshrink(int);
 
 // console.c
 void            consoleinit(void);
@@ -43,6 +51,7 @@ struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
+int             ishrink(int);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
@@ -50,6 +59,7 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+int             readahead(struct inode*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 uint            call_bmap(struct inode*, uint);
@@ -58,6 +68,7 @@ uint            call_bmap(struct inode*, uint);
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            ideasync(struct buf*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -66,6 +77,17 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_order(int);
+void            kfree_order(char*, int);
+int             kfreeblocks(uint*);
+uint            kfreepages(void);
+void            kcharge(char*, int);
+void            ksplit(char*, int);
+void            meminfo(struct meminfo*);
+void            kref(char*);
+int             krefcount(char*);
+char*           kzalloc(void);
+int             kzerofill(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
@@ -78,7 +100,10 @@ void            cmostime(struct rtcdate *r);
 int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
+void            lapicipi(int, int);
 void            lapicinit(void);
+void            lapiconeshot(uint, int);
+void            lapicperiodic(void);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
@@ -96,8 +121,17 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// mmap.c
+int             mmap(struct file*, uint, uint, int);
+int             munmap(uint, uint);
+void            munmapall(struct proc*);
+int             mmapfault(struct proc*, uint, uint);
+int             mmapfork(struct proc*, struct proc*);
+int             mmapvalid(struct proc*, uint, uint, int);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
+void            pipeinit(void);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
@@ -125,13 +159,17 @@ void            get_parent_pid(void);
 void            set_process_parent(int);
 void            get_children_pid(int);
 // addeds for lab3
-struct proc*    RR_scheduler(int* index);
-struct proc*    LCFS_scheduler(void);
-struct proc*    MHRRN_scheduler(void);
 void            set_HRRN_priority_sys(int);
 void            set_HRRN_priority_proc(int, int);
 void            set_schedule_queue(int, int);
+void            set_queue_quantum(int, int);
+int             set_affinity(int, uint);
+int             get_affinity(int);
+int             slice_expired(struct proc*);
 void            print_info(void);
+void            schedtick(void);
+int             schedstat(int, struct schedstat*);
+char*           swapvictim(int*);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -151,6 +189,23 @@ void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
+// shm.c
+void            shminit(void);
+int             shmopen(int, uint);
+int             shmattach(int);
+int             shmdetach(uint);
+int             shmunlink(int);
+int             shmfork(struct proc*, struct proc*);
+void            shmdetachall(struct proc*);
+
+// slab.c
+void            slabinit(struct slabcache*, char*, uint);
+void*           slaballoc(struct slabcache*);
+void            slabfree(struct slabcache*, void*);
+void*           slabget(struct slabcache*);
+int             slabput(struct slabcache*, void*);
+void            slabstat(struct meminfo*);
+
 // string.c
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
@@ -160,9 +215,20 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// swap.c
+void            swapinit(int);
+int             swapalloc(void);
+void            swapdup(int);
+void            swapfree(int);
+void            swapread(int, char*);
+int             swapout(int);
+char*           allocuser(int);
+void            swapstat(struct vmstat*);
+
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argrdptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
@@ -170,6 +236,11 @@ void            syscall(void);
 
 // timer.c
 void            timerinit(void);
+uint64          ticks2tsc(uint);
+uint64          us2tsc(uint);
+int             sleepuntil(uint64);
+void            timertick(void);
+void            hrtimerintr(void);
 
 // trap.c
 void            idtinit(void);
@@ -191,8 +262,15 @@ int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
+int             pagefault(struct proc*, uint, uint);
+int             pagein(struct proc*, uint, uint, int);
+int             mapshared(pde_t*, uint, char**, uint, int);
+char*           uvapage(pde_t*, uint, uint*);
+void            flushtlb(pde_t*);
+void            vmstat(struct vmstat*);
+char*           clockscan(struct proc*, uint*, int*);
+uint            rss(pde_t*);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
@@ -9,17 +9,22 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
 
 struct devsw devsw[NDEV];
+
+// Open files come from a slab cache, so there is no fixed
+// limit on them.  ftable.lock protects the reference counts.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct slabcache cache;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  slabinit(&ftable.cache, "file", sizeof(struct file));
 }
 
 // Allocate a file structure.
@@ -28,16 +33,10 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = slaballoc(&ftable.cache)) == 0)
+    return 0;
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -69,6 +68,7 @@ fileclose(struct file *f)
   f->ref = 0;
   f->type = FD_NONE;
   release(&ftable.lock);
+  slabfree(&ftable.cache, f);
 
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
@@ -92,6 +92,45 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
+#define RAMIN 4   // First read-ahead window, in blocks
+
+// Read ahead of a sequential reader about to read n bytes
+// at f->off.  A read that starts where the last one ended is
+// sequential; a read anywhere else turns read-ahead off.  Once
+// the reader comes within half a window of what has been read
+// ahead, start reading the next window.  The window doubles,
+// up to RAMAX, if the block the reader is at was still cached,
+// and halves if it had been evicted before the reader got to it.
+// Caller holds f->ip->lock.
+static void
+fileahead(struct file *f, int n)
+{
+  uint end;
+
+  if(f->off != f->ranext){
+    f->rawin = 0;
+    f->raend = 0;
+  } else if(f->rawin == 0)
+    f->rawin = RAMIN;
+  f->ranext = f->off + n;
+  if(f->rawin == 0 || f->raend >= f->ranext + f->rawin*BSIZE/2)
+    return;
+
+  if(f->raend > f->off){
+    if(readahead(f->ip, f->off, 1))
+      f->rawin = f->rawin*2 > RAMAX ? RAMAX : f->rawin*2;
+    else if(f->rawin > RAMIN)
+      f->rawin /= 2;
+  }
+  end = f->ranext + f->rawin*BSIZE;
+  if(f->raend < f->ranext)
+    f->raend = f->ranext;
+  if(end > f->raend){
+    readahead(f->ip, f->raend, end - f->raend);
+    f->raend = end;
+  }
+}
+
 // Read from file f.
 int
 fileread(struct file *f, char *addr, int n)
@@ -104,6 +143,7 @@ fileread(struct file *f, char *addr, int n)
     return piperead(f->pipe, addr, n);
   if(f->type == FD_INODE){
     ilock(f->ip);
+    fileahead(f, n);
     if((r = readi(f->ip, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
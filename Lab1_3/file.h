@@ -6,6 +6,9 @@ struct file {
   struct pipe *pipe;
   struct inode *ip;
   uint off;
+  uint ranext;  // where a sequential read would start
+  uint raend;   // blocks before here have been read ahead
+  uint rawin;   // read-ahead window in blocks, 0 if off
 };
 
 
@@ -14,6 +17,8 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *next; // icache list, protected by icache.lock
+  struct inode *prev;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -20,6 +20,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "slab.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
@@ -155,9 +156,15 @@ bfree(int dev, uint b)
 // multi-step atomic operations.
 //
 // The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// entries. In-memory inodes come from a slab cache and sit on
+// the icache list, most recently used first. An entry whose
+// last reference goes stays cached if it is valid, so that a
+// later iget() finds it without reading the disk; ishrink()
+// frees such entries, least recently used first, when memory
+// runs low. Since ip->ref indicates whether an entry is in
+// use, and ip->dev and ip->inum indicate which i-node an entry
+// holds, one must hold icache.lock while using any of those
+// fields or the list links.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
@@ -165,18 +172,36 @@ bfree(int dev, uint b)
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct slabcache cache;
+  // Circular list of cached inodes.
+  // head.next is most recent, head.prev is least.
+  struct inode head;
 } icache;
 
+static void
+icache_unlink(struct inode *ip)
+{
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+}
+
+// Move or add ip to the most recently used end of the list.
+static void
+icache_push(struct inode *ip)
+{
+  ip->next = icache.head.next;
+  ip->prev = &icache.head;
+  icache.head.next->prev = ip;
+  icache.head.next = ip;
+}
+
 void
 iinit(int dev)
 {
-  int i = 0;
-  
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  slabinit(&icache.cache, "inode", sizeof(struct inode));
+  icache.head.next = &icache.head;
+  icache.head.prev = &icache.head;
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
@@ -241,31 +266,31 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
 
   acquire(&icache.lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+  for(ip = icache.head.next; ip != &icache.head; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
       ip->ref++;
+      icache_unlink(ip);
+      icache_push(ip);
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
+  // Allocate a new inode cache entry.
+  if((ip = slabget(&icache.cache)) == 0)
     panic("iget: no inodes");
 
-  ip = empty;
+  initsleeplock(&ip->lock, "inode");
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  icache_push(ip);
   release(&icache.lock);
 
   return ip;
@@ -322,8 +347,8 @@ iunlock(struct inode *ip)
 }
 
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode cache entry can
-// be recycled.
+// If that was the last reference, the inode cache entry is
+// kept for reuse if it is valid, and freed otherwise.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -347,8 +372,35 @@ iput(struct inode *ip)
   releasesleep(&ip->lock);
 
   acquire(&icache.lock);
-  ip->ref--;
+  if(--ip->ref > 0 || ip->valid){
+    release(&icache.lock);
+    return;
+  }
+  icache_unlink(ip);
+  release(&icache.lock);
+  slabput(&icache.cache, ip);
+}
+
+// Free unused inode cache entries, least recently used first,
+// until n pages of memory have gone back to kalloc(), when
+// memory runs low.  Returns how many pages were freed.
+int
+ishrink(int n)
+{
+  struct inode *ip, *prev;
+  int done;
+
+  done = 0;
+  acquire(&icache.lock);
+  for(ip = icache.head.prev; ip != &icache.head && done < n; ip = prev){
+    prev = ip->prev;
+    if(ip->ref > 0)
+      continue;
+    icache_unlink(ip);
+    done += slabput(&icache.cache, ip);
+  }
   release(&icache.lock);
+  return done;
 }
 
 // Common idiom: unlock, then put.
@@ -481,6 +533,28 @@ readi(struct inode *ip, char *dst, uint off, uint n)
   return n;
 }
 
+// Start reading the blocks of ip that hold [off, off+n) into
+// the buffer cache, without waiting for them.  Returns how many
+// were cached already.
+// Caller must hold ip->lock.
+int
+readahead(struct inode *ip, uint off, uint n)
+{
+  uint bn, last;
+  int hit;
+
+  if(ip->type == T_DEV || off >= ip->size || n == 0)
+    return 0;
+  if(n > ip->size - off)
+    n = ip->size - off;
+
+  hit = 0;
+  last = (off + n - 1) / BSIZE;
+  for(bn = off/BSIZE; bn <= last; bn++)
+    hit += breada(ip->dev, bmap(ip, bn));
+  return hit;
+}
+
 // PAGEBREAK!
 // Write data to inode.
 // Caller must hold ip->lock.
@@ -0,0 +1,198 @@
+// Tests of the disk block cache and read-ahead.  Like
+// usertests, each test prints OK or exits early with a message
+// saying what went wrong.
+
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "meminfo.h"
+
+char buf[BSIZE];
+int stdout = 1;
+struct meminfo mi;
+
+// Write a file of nblocks blocks whose block i is filled with
+// the byte seed + i.
+void
+mkfile(char *name, int nblocks, int seed)
+{
+  int fd, i;
+
+  unlink(name);
+  fd = open(name, O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "create %s failed\n", name);
+    exit();
+  }
+  for(i = 0; i < nblocks; i++){
+    memset(buf, seed + i, BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf(stdout, "write %s failed\n", name);
+      exit();
+    }
+  }
+  close(fd);
+}
+
+// Read a file made by mkfile() back, n bytes at a time, and
+// check every byte.  Returns 0 if the data is wrong.
+int
+checkfile(char *name, int nblocks, int seed, int n)
+{
+  int fd, i, off, cc;
+
+  fd = open(name, O_RDONLY);
+  if(fd < 0){
+    printf(stdout, "open %s failed\n", name);
+    exit();
+  }
+  off = 0;
+  while((cc = read(fd, buf, n)) > 0){
+    for(i = 0; i < cc; i++, off++)
+      if(buf[i] != (char)(seed + off / BSIZE)){
+        close(fd);
+        return 0;
+      }
+  }
+  close(fd);
+  return off == nblocks * BSIZE;
+}
+
+// do processes on several CPUs reading different files at
+// once through the hashed buffer cache each see their own data?
+void
+bcachetest(void)
+{
+  char name[3], ok;
+  int fds[2], i, pass;
+
+  printf(stdout, "buffer cache test\n");
+  if(pipe(fds) != 0){
+    printf(stdout, "buffer cache test pipe failed\n");
+    exit();
+  }
+  name[0] = 'b';
+  name[2] = 0;
+  for(i = 0; i < 4; i++){
+    name[1] = '0' + i;
+    mkfile(name, 20, i * 20);
+  }
+  for(i = 0; i < 4; i++){
+    if(fork() == 0){
+      name[1] = '0' + i;
+      ok = 1;
+      for(pass = 0; pass < 5; pass++)
+        if(!checkfile(name, 20, i * 20, BSIZE))
+          ok = 0;
+      write(fds[1], &ok, 1);
+      exit();
+    }
+  }
+  for(i = 0; i < 4; i++){
+    if(read(fds[0], &ok, 1) != 1 || !ok){
+      printf(stdout, "buffer cache test: a file read back wrong\n");
+      exit();
+    }
+    wait();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  for(i = 0; i < 4; i++){
+    name[1] = '0' + i;
+    unlink(name);
+  }
+  printf(stdout, "buffer cache test OK\n");
+}
+
+// does the buffer cache grow past NBUF blocks to hold a file
+// bigger than that, within BCACHEPAGES of memory?
+void
+growtest(void)
+{
+  printf(stdout, "buffer cache growth test\n");
+  mkfile("growfile", 120, 0);
+  if(!checkfile("growfile", 120, 0, BSIZE)){
+    printf(stdout, "buffer cache growth test: read back wrong\n");
+    exit();
+  }
+  if(meminfo(&mi) < 0){
+    printf(stdout, "buffer cache growth test meminfo failed\n");
+    exit();
+  }
+  if(mi.nbuf <= NBUF){
+    printf(stdout, "buffer cache growth test: only %d buffers\n", mi.nbuf);
+    exit();
+  }
+  if(mi.bufbytes > BCACHEPAGES * 4096){
+    printf(stdout, "buffer cache growth test: cache too big\n");
+    exit();
+  }
+  unlink("growfile");
+  printf(stdout, "buffer cache growth test OK\n");
+}
+
+// do sequential reads in sizes that don't line up with blocks
+// see the right data while blocks are read ahead, and does a
+// reader at the end of a file see blocks appended later?
+void
+readaheadtest(void)
+{
+  int fd, wfd, i, j;
+
+  printf(stdout, "read-ahead test\n");
+  mkfile("rafile", 100, 7);
+  if(!checkfile("rafile", 100, 7, 37) || !checkfile("rafile", 100, 7, 511) ||
+     !checkfile("rafile", 100, 7, BSIZE)){
+    printf(stdout, "read-ahead test: read back wrong\n");
+    exit();
+  }
+
+  fd = open("rafile", O_RDONLY);
+  wfd = open("rafile", O_WRONLY);
+  if(fd < 0 || wfd < 0){
+    printf(stdout, "read-ahead test open failed\n");
+    exit();
+  }
+  while(read(fd, buf, BSIZE) > 0)
+    ;
+  // rewrite the file as it was, then append to it
+  for(i = 0; i < 105; i++){
+    memset(buf, 7 + i, BSIZE);
+    if(write(wfd, buf, BSIZE) != BSIZE){
+      printf(stdout, "read-ahead test write failed\n");
+      exit();
+    }
+  }
+  for(i = 100; i < 105; i++){
+    if(read(fd, buf, BSIZE) != BSIZE){
+      printf(stdout, "read-ahead test: appended block missing\n");
+      exit();
+    }
+    for(j = 0; j < BSIZE; j++){
+      if(buf[j] != (char)(7 + i)){
+        printf(stdout, "read-ahead test: appended block wrong\n");
+        exit();
+      }
+    }
+  }
+  close(fd);
+  close(wfd);
+  unlink("rafile");
+  printf(stdout, "read-ahead test OK\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  printf(stdout, "fstests starting\n");
+
+  bcachetest();
+  growtest();
+  readaheadtest();
+
+  printf(stdout, "ALL FS TESTS PASSED\n");
+  exit();
+}
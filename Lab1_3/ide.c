@@ -75,7 +75,7 @@ idestart(struct buf *b)
 {
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  if(b->blockno >= FSSIZE+SWAPBLOCKS)
     panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
@@ -104,6 +104,7 @@ void
 ideintr(void)
 {
   struct buf *b;
+  int async;
 
   // First queued buffer is the active request.
   acquire(&idelock);
@@ -119,8 +120,9 @@ ideintr(void)
     insl(0x1f0, b->data, BSIZE/4);
 
   // Wake process waiting for this buf.
+  async = b->flags & B_ASYNC;
   b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
+  b->flags &= ~(B_DIRTY|B_ASYNC);
   wakeup(b);
 
   // Start disk on next buf in queue.
@@ -128,6 +130,27 @@ ideintr(void)
     idestart(idequeue);
 
   release(&idelock);
+
+  // Nobody waits for a read-ahead; release its buf.
+  if(async)
+    bdone(b);
+}
+
+// Append b to idequeue, starting the disk if it is idle.
+// Caller must hold idelock.
+static void
+ideappend(struct buf *b)
+{
+  struct buf **pp;
+
+  b->qnext = 0;
+  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
+    ;
+  *pp = b;
+
+  // Start disk if necessary.
+  if(idequeue == b)
+    idestart(b);
 }
 
 //PAGEBREAK!
@@ -137,8 +160,6 @@ ideintr(void)
 void
 iderw(struct buf *b)
 {
-  struct buf **pp;
-
   if(!holdingsleep(&b->lock))
     panic("iderw: buf not locked");
   if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
@@ -148,15 +169,7 @@ iderw(struct buf *b)
 
   acquire(&idelock);  //DOC:acquire-lock
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-    ;
-  *pp = b;
-
-  // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
+  ideappend(b);
 
   // Wait for request to finish.
   while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
@@ -166,3 +179,21 @@ iderw(struct buf *b)
 
   release(&idelock);
 }
+
+// Start reading locked buf b from disk without waiting.
+// ideintr() releases b with bdone() when the read is done.
+void
+ideasync(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("ideasync: buf not locked");
+  if(b->flags & (B_VALID|B_DIRTY))
+    panic("ideasync: nothing to do");
+  if(b->dev != 0 && !havedisk1)
+    panic("ideasync: ide disk 1 not present");
+
+  acquire(&idelock);
+  b->flags |= B_ASYNC;
+  ideappend(b);
+  release(&idelock);
+}
@@ -1,6 +1,7 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, and blocks of
+// 2^n physically contiguous pages.
 
 #include "types.h"
 #include "defs.h"
@@ -8,6 +9,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "meminfo.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
@@ -15,14 +17,68 @@ extern char end[]; // first address after kernel loaded from ELF file
 
 struct run {
   struct run *next;
+  struct run *prev;            // Only kept up to date on kmem.free lists
+};
+
+// Free memory is kept by a binary buddy allocator.  A free
+// block of order k is 2^k pages, aligned to its size, and sits
+// on kmem.free[k].  Freeing a block merges it with its buddy,
+// the other half of the next larger block, for as long as the
+// buddy is free and whole too.  blkorder[] marks the first page
+// of each free block with its order + 1.
+static uchar blkorder[PHYSTOP/PGSIZE];
+#define PFN(v) (V2P(v)/PGSIZE)
+
+// Each CPU keeps a small cache of free pages that it uses with
+// interrupts off, under a lock of its own that other CPUs only
+// take when they run out.  An empty cache refills a batch of
+// pages from the buddy allocator under kmem.lock, and a full
+// one drains a batch back, so most kalloc() and kfree() calls
+// never touch kmem.lock.  When the buddy allocator is empty
+// too, kalloc() steals a batch from another CPU's cache, so
+// no free page is stranded while an allocation fails.
+#define KCACHEBATCH  32         // Pages moved per refill, drain or steal
+#define KCACHEMAX    64         // Drain once a cache holds more
+
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
 };
 
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
+  struct run *free[MAXORDER+1];
+  uint nfree[MAXORDER+1];      // Blocks on each free list
+  struct kcache cache[NCPU];
 } kmem;
 
+// Reference counts of physical pages, which fork shares
+// copy-on-write.  kfree() only frees a page with its last
+// reference.  Updated with atomic instructions, since pages
+// move between lists under different locks or none.
+static int pgref[PHYSTOP/PGSIZE];
+#define PGREF(v) pgref[V2P(v)/PGSIZE]
+
+// What each allocated block is used for, as MEM_ kind | order<<4
+// in the entry of its first page, and the pages in use of each
+// kind.  Updated without locks, like pgref.
+static uchar pgkind[PHYSTOP/PGSIZE];
+static int kindpages[NMEMCAT];
+static uint npages;            // Pages handed to the allocator at boot
+#define PGKIND(v) pgkind[V2P(v)/PGSIZE]
+
+// Free pages that idle CPUs have already zeroed, for kzalloc().
+// kalloc() falls back on them once the other free pages run out.
+#define KZEROMAX     256
+
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+} kzero;
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
@@ -31,7 +87,12 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  initlock(&kzero.lock, "kzero");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kmem.cache[i].lock, "kcache");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -48,32 +109,318 @@ freerange(void *vstart, void *vend)
 {
   char *p;
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
+    PGREF(p) = 1;
     kfree(p);
+    npages++;
+  }
 }
+
+static void
+buddy_push(char *v, int order)
+{
+  struct run *r = (struct run*)v;
+
+  r->prev = 0;
+  r->next = kmem.free[order];
+  if(r->next)
+    r->next->prev = r;
+  kmem.free[order] = r;
+  kmem.nfree[order]++;
+  blkorder[PFN(v)] = order + 1;
+}
+
+static void
+buddy_unlink(struct run *r, int order)
+{
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.free[order] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  kmem.nfree[order]--;
+  blkorder[PFN(r)] = 0;
+}
+
+// Take a block of 2^order pages, splitting a larger one if
+// need be.  Caller holds kmem.lock, or is still booting.
+static char*
+buddy_alloc(int order)
+{
+  struct run *r;
+  int k;
+
+  for(k = order; k <= MAXORDER && kmem.free[k] == 0; k++)
+    ;
+  if(k > MAXORDER)
+    return 0;
+  r = kmem.free[k];
+  buddy_unlink(r, k);
+  // Keep the lower half, give back the upper one.
+  while(k > order){
+    k--;
+    buddy_push((char*)r + (PGSIZE << k), k);
+  }
+  return (char*)r;
+}
+
+// Give back the block of 2^order pages at v, merging it with
+// free buddies.  Caller holds kmem.lock, or is still booting.
+static void
+buddy_free(char *v, int order)
+{
+  uint pfn, buddy;
+
+  pfn = PFN(v);
+  while(order < MAXORDER){
+    buddy = pfn ^ (1 << order);
+    if(buddy >= PHYSTOP/PGSIZE || blkorder[buddy] != order + 1)
+      break;
+    buddy_unlink((struct run*)P2V(buddy * PGSIZE), order);
+    pfn &= ~(1 << order);
+    order++;
+  }
+  buddy_push(P2V(pfn * PGSIZE), order);
+}
+
+// Move up to KCACHEBATCH pages from the buddy allocator to kc.
+static void
+refill(struct kcache *kc)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while(kc->n < KCACHEBATCH && (r = (struct run*)buddy_alloc(0)) != 0){
+    r->next = kc->freelist;
+    kc->freelist = r;
+    kc->n++;
+  }
+  release(&kmem.lock);
+}
+
+// Give KCACHEBATCH pages from kc back to the buddy allocator.
+static void
+drain(struct kcache *kc)
+{
+  struct run *r;
+  int i;
+
+  acquire(&kmem.lock);
+  for(i = 0; i < KCACHEBATCH && (r = kc->freelist) != 0; i++){
+    kc->freelist = r->next;
+    kc->n--;
+    buddy_free((char*)r, 0);
+  }
+  release(&kmem.lock);
+}
+
+// Move up to KCACHEBATCH pages from other CPUs' caches to kc,
+// which is empty, holding one cache lock at a time.
+static void
+steal(struct kcache *kc)
+{
+  struct kcache *other;
+  struct run *r, *list;
+  int n;
+
+  list = 0;
+  n = 0;
+  for(other = kmem.cache; other < &kmem.cache[NCPU] && n == 0; other++){
+    if(other == kc || other->n == 0)
+      continue;
+    acquire(&other->lock);
+    while(n < KCACHEBATCH && (r = other->freelist) != 0){
+      other->freelist = r->next;
+      other->n--;
+      r->next = list;
+      list = r;
+      n++;
+    }
+    release(&other->lock);
+  }
+
+  acquire(&kc->lock);
+  while((r = list) != 0){
+    list = r->next;
+    r->next = kc->freelist;
+    kc->freelist = r;
+    kc->n++;
+  }
+  release(&kc->lock);
+}
+
 //PAGEBREAK: 21
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed
+// at by v, and free it if that was the last one.  v normally
+// should have been returned by a call to kalloc().  (The
+// exception is when initializing the allocator; see kinit above.)
 void
 kfree(char *v)
 {
   struct run *r;
+  struct kcache *kc;
+  int ref;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
+  ref = __sync_sub_and_fetch(&PGREF(v), 1);
+  if(ref > 0)
+    return;
+  if(ref < 0)
+    panic("kfree: ref");
 
+#ifdef KFREEJUNK
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+  if(!kmem.use_lock){
+    // Still booting on one CPU; mycpu() may not work yet.
+    buddy_free(v, 0);
+    return;
+  }
+  __sync_fetch_and_sub(&kindpages[PGKIND(v) & 0xF], 1);
+
+  pushcli();
+  kc = &kmem.cache[cpuid()];
+  acquire(&kc->lock);
+  r->next = kc->freelist;
+  kc->freelist = r;
+  if(++kc->n > KCACHEMAX)
+    drain(kc);
+  release(&kc->lock);
+  popcli();
+}
+
+// Take a page from this CPU's cache, or straight from the
+// buddy allocator while booting.  Returns 0 only when the
+// buddy allocator and every CPU's cache are empty.
+static struct run*
+allocpage(void)
+{
+  struct run *r;
+  struct kcache *kc;
+
+  if(!kmem.use_lock)
+    return (struct run*)buddy_alloc(0);
+
+  pushcli();
+  kc = &kmem.cache[cpuid()];
+  acquire(&kc->lock);
+  if(kc->freelist == 0)
+    refill(kc);
+  if(kc->freelist == 0){
+    release(&kc->lock);
+    steal(kc);
+    acquire(&kc->lock);
+  }
+  r = kc->freelist;
+  if(r){
+    kc->freelist = r->next;
+    kc->n--;
+  }
+  release(&kc->lock);
+  popcli();
+  return r;
+}
+
+// Take a page from the pre-zeroed pool.  Only its first
+// word, the list link, needs clearing again.
+static char*
+zeroedpage(void)
+{
+  struct run *r;
+
+  if(kzero.n == 0)
+    return 0;
+  acquire(&kzero.lock);
+  r = kzero.freelist;
+  if(r){
+    kzero.freelist = r->next;
+    kzero.n--;
+    r->next = 0;
+  }
+  release(&kzero.lock);
+  return (char*)r;
+}
+
+// Charge a newly allocated block of 2^order pages to MEM_OTHER,
+// until its user says what it is for.
+static void
+charge(char *v, int order)
+{
+  PGKIND(v) = MEM_OTHER | order<<4;
+  __sync_fetch_and_add(&kindpages[MEM_OTHER], 1 << order);
+}
+
+// Allocate 2^order physically contiguous pages, aligned to
+// their size and not zeroed.  Returns 0 if there is no free
+// block that large.  The pages are not reference counted:
+// give them back with kfree_order(), not kfree().
+char*
+kalloc_order(int order)
+{
+  char *v;
+
+  if(order < 0 || order > MAXORDER)
+    return 0;
+  acquire(&kmem.lock);
+  v = buddy_alloc(order);
+  release(&kmem.lock);
+  if(v)
+    charge(v, order);
+  return v;
+}
+
+void
+kfree_order(char *v, int order)
+{
+  if(order < 0 || order > MAXORDER || V2P(v) % (PGSIZE << order) ||
+     v < end || V2P(v) >= PHYSTOP)
+    panic("kfree_order");
+#ifdef KFREEJUNK
+  memset(v, 1, PGSIZE << order);
+#endif
+  __sync_fetch_and_sub(&kindpages[PGKIND(v) & 0xF], 1 << order);
+  acquire(&kmem.lock);
+  buddy_free(v, order);
+  release(&kmem.lock);
+}
+
+// Copy out the number of free blocks of each order, and
+// return the number of free pages held outside the buddy
+// allocator, in per-CPU caches and the zeroed pool.
+int
+kfreeblocks(uint *nfree)
+{
+  int i, n;
+
+  acquire(&kmem.lock);
+  for(i = 0; i <= MAXORDER; i++)
+    nfree[i] = kmem.nfree[i];
+  n = kzero.n;
+  for(i = 0; i < NCPU; i++)
+    n += kmem.cache[i].n;
+  release(&kmem.lock);
+  return n;
+}
+
+// Return roughly how many pages are free.  Read without
+// kmem.lock, so only good for deciding when memory is low.
+uint
+kfreepages(void)
+{
+  uint n;
+  int i;
+
+  n = kzero.n;
+  for(i = 0; i <= MAXORDER; i++)
+    n += kmem.nfree[i] << i;
+  for(i = 0; i < NCPU; i++)
+    n += kmem.cache[i].n;
+  return n;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -82,15 +429,105 @@ kfree(char *v)
 char*
 kalloc(void)
 {
-  struct run *r;
+  char *v;
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  if(kmem.use_lock)
-    release(&kmem.lock);
-  return (char*)r;
+  if((v = (char*)allocpage()) == 0)
+    v = zeroedpage();
+  if(v){
+    PGREF(v) = 1;
+    charge(v, 0);
+  }
+  return v;
 }
 
+// Allocate one zeroed page, ready-made if an idle CPU
+// has prepared one.
+char*
+kzalloc(void)
+{
+  char *v;
+
+  if((v = zeroedpage()) != 0){
+    PGREF(v) = 1;
+    charge(v, 0);
+  } else if((v = kalloc()) != 0)
+    memset(v, 0, PGSIZE);
+  return v;
+}
+
+// Charge the block at v, from kalloc() or kalloc_order(),
+// to MEM_ kind, for meminfo.
+void
+kcharge(char *v, int kind)
+{
+  int old = PGKIND(v);
+
+  __sync_fetch_and_sub(&kindpages[old & 0xF], 1 << (old >> 4));
+  __sync_fetch_and_add(&kindpages[kind], 1 << (old >> 4));
+  PGKIND(v) = kind | (old & 0xF0);
+}
+
+// The block of 2^order pages at v, from kalloc_order(), is
+// about to become ordinary pages, each freed with kfree().
+// Charge each page on its own.
+void
+ksplit(char *v, int order)
+{
+  int i, kind;
+
+  kind = PGKIND(v) & 0xF;
+  for(i = 0; i < 1<<order; i++)
+    PGKIND(v + i*PGSIZE) = kind;
+}
+
+// Fill in the page counts of *mi for the meminfo system call.
+void
+meminfo(struct meminfo *mi)
+{
+  uint nfree[MAXORDER+1];
+  int i;
+
+  memset(mi, 0, sizeof(*mi));
+  mi->total = npages;
+  mi->free = kfreeblocks(nfree);
+  for(i = 0; i <= MAXORDER; i++)
+    mi->free += nfree[i] << i;
+  for(i = 0; i < NMEMCAT; i++)
+    mi->used[i] = kindpages[i];
+  mi->kernel = (PGROUNDUP(V2P(end)) - EXTMEM) / PGSIZE;
+  slabstat(mi);
+  bcachestat(mi);
+}
+
+// Add a reference to the page at v, which is being shared.
+void
+kref(char *v)
+{
+  __sync_fetch_and_add(&PGREF(v), 1);
+}
+
+int
+krefcount(char *v)
+{
+  return PGREF(v);
+}
+
+// Called by a CPU with nothing to run: zero one free page for
+// kzalloc().  Returns 0 when there is nothing left to do.
+int
+kzerofill(void)
+{
+  struct run *r;
+
+  if(!kmem.use_lock || kzero.n >= KZEROMAX)
+    return 0;
+  if((r = allocpage()) == 0)
+    return 0;
+  memset(r, 0, PGSIZE);
+  acquire(&kzero.lock);
+  r->next = kzero.freelist;
+  kzero.freelist = r;
+  kzero.n++;
+  release(&kzero.lock);
+  return 1;
+}
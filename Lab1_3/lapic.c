@@ -32,6 +32,7 @@
 #define TIMER   (0x0320/4)   // Local Vector Table 0 (TIMER)
   #define X1         0x0000000B   // divide counts by 1
   #define PERIODIC   0x00020000   // Periodic
+  #define TICKCOUNT  10000000     // Counts between timer interrupts
 #define PCINT   (0x0340/4)   // Performance Counter LVT
 #define LINT0   (0x0350/4)   // Local Vector Table 1 (LINT0)
 #define LINT1   (0x0360/4)   // Local Vector Table 2 (LINT1)
@@ -66,7 +67,7 @@ lapicinit(void)
   // TICR would be calibrated using an external time source.
   lapicw(TDCR, X1);
   lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  lapicw(TICR, TICKCOUNT);
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -105,6 +106,48 @@ lapicid(void)
   return lapic[ID] >> 24;
 }
 
+// Send interrupt vector to the CPU with the given APIC ID.
+void
+lapicipi(int apicid, int vector)
+{
+  if(!lapic)
+    return;
+  // Keep an interrupt handler on this CPU from writing
+  // the ICR between our two writes.
+  pushcli();
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+  popcli();
+}
+
+// Replace the periodic timer with a single interrupt on vector
+// T_IRQ0+irq, frac/65536 of a tick from now.
+void
+lapiconeshot(uint frac, int irq)
+{
+  uint n;
+
+  if(!lapic)
+    return;
+  n = ((uint64)TICKCOUNT * frac) >> 16;
+  if(n == 0)
+    n = 1;
+  lapicw(TIMER, T_IRQ0 + irq);
+  lapicw(TICR, n);
+}
+
+// Go back to the periodic timer, a full tick from now.
+void
+lapicperiodic(void)
+{
+  if(!lapic)
+    return;
+  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TICR, TICKCOUNT);
+}
+
 // Acknowledge interrupt.
 void
 lapiceoi(void)
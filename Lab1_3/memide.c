@@ -58,3 +58,11 @@ iderw(struct buf *b)
     memmove(b->data, p, BSIZE);
   b->flags |= B_VALID;
 }
+
+// The memory disk is never slow; read b now and release it.
+void
+ideasync(struct buf *b)
+{
+  iderw(b);
+  bdone(b);
+}
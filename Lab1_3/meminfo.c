@@ -0,0 +1,41 @@
+#include "param.h"
+#include "types.h"
+#include "user.h"
+#include "meminfo.h"
+
+// Usage: meminfo
+// Prints where physical memory goes: the pages in use for each
+// kind of kernel and user memory, the buffer cache, and the
+// slab caches.
+
+struct meminfo mi;
+
+char *kinds[NMEMCAT] = {
+    [MEM_OTHER]  "other",
+    [MEM_KSTACK] "kstack",
+    [MEM_PGTBL]  "pgtbl",
+    [MEM_USER]   "user",
+    [MEM_SHM]    "shm",
+    [MEM_SLAB]   "slab",
+};
+
+int main(int argc, char* argv[])
+{
+    if (meminfo(&mi) < 0)
+    {
+        printf(1, "meminfo failed\n");
+        exit();
+    }
+    printf(1, "pages: %d total, %d free, %d used\n", mi.total, mi.free, mi.total - mi.free);
+    for (int i = 0; i < NMEMCAT; i++)
+        printf(1, "  %s: %d\n", kinds[i], mi.used[i]);
+    printf(1, "kernel image: %d pages\n", mi.kernel);
+    printf(1, "buffer cache: %d blocks, %d KB\n\n", mi.nbuf, mi.bufbytes / 1024);
+    printf(1, "slab cache  size  slabs  objects\n");
+    for (int i = 0; i < mi.nslab; i++)
+    {
+        struct slabinfo *s = &mi.slab[i];
+        printf(1, "%s  %d  %d  %d\n", s->name, s->size, s->nslabs, s->nobjs);
+    }
+    exit();
+}
@@ -0,0 +1,31 @@
+// Physical memory use, filled in by the meminfo system call.
+// Every page kalloc() hands out is charged to what it is used
+// for; see kcharge().
+
+#define MEM_OTHER   0           // Anything not listed below
+#define MEM_KSTACK  1           // Kernel stacks
+#define MEM_PGTBL   2           // Page directories and page tables
+#define MEM_USER    3           // User memory, including file mappings
+#define MEM_SHM     4           // Shared memory segments
+#define MEM_SLAB    5           // Slab caches: pipes, files, inodes, buffers
+#define NMEMCAT     6
+
+#define NSLABINFO   8           // Slab caches reported
+
+struct slabinfo {
+  char name[16];
+  uint size;                    // Object size in bytes
+  uint nslabs;                  // Pages
+  uint nobjs;                   // Objects in use or in magazines
+};
+
+struct meminfo {
+  uint total;                   // Pages kalloc() manages
+  uint free;                    // Pages free, wherever they are kept
+  uint used[NMEMCAT];           // Pages in use for each MEM_ kind
+  uint kernel;                  // Pages of kernel text and data
+  uint nbuf;                    // Buffer cache blocks
+  uint bufbytes;                // Bytes the buffer cache takes up
+  int nslab;
+  struct slabinfo slab[NSLABINFO];
+};
@@ -0,0 +1,255 @@
+// Tests of the kernel memory allocators: the per-CPU page
+// caches, page zeroing, the buddy allocator and the slab
+// caches.  Like usertests, each test prints OK or exits early
+// with a message saying what went wrong.  They expect the
+// rest of the system to be idle.
+
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "vmstat.h"
+#include "meminfo.h"
+
+int stdout = 1;
+struct meminfo mi;
+struct vmstat st;
+
+// Free pages, wherever the kernel keeps them.
+uint
+freepages(void)
+{
+  if(meminfo(&mi) < 0){
+    printf(stdout, "meminfo failed\n");
+    exit();
+  }
+  return mi.free;
+}
+
+// do pages freed on one CPU get used by the others, and does
+// every page come back once processes on all CPUs have grown
+// and shrunk their memory many times?
+void
+kcachetest(void)
+{
+  uint before;
+  int i, j, n;
+  char *a;
+
+  printf(stdout, "page cache test\n");
+  vmstat(&st);
+  n = 2 * st.ncpu;
+  before = freepages();
+  for(i = 0; i < n; i++){
+    if(fork() == 0){
+      for(j = 0; j < 50; j++){
+        a = sbrk(64*4096);
+        if(a == (char*)0xffffffff){
+          printf(stdout, "page cache test sbrk failed\n");
+          exit();
+        }
+        for(a = sbrk(0) - 64*4096; a < sbrk(0); a += 4096)
+          *a = j;
+        sbrk(-64*4096);
+      }
+      exit();
+    }
+  }
+  for(i = 0; i < n; i++)
+    wait();
+  // a few pages may stay in page tables or slabs
+  if(freepages() + 16 < before){
+    printf(stdout, "page cache test: %d pages lost\n", before - mi.free);
+    exit();
+  }
+  printf(stdout, "page cache test OK\n");
+}
+
+// are user pages zero when they are handed out, even after
+// another process dirtied and freed them, and when the
+// kernel fills only part of a fresh page with read()?
+void
+zerotest(void)
+{
+  int fds[2], i;
+  char *a;
+
+  printf(stdout, "zero test\n");
+  if(fork() == 0){
+    a = sbrk(256*4096);
+    if(a == (char*)0xffffffff)
+      exit();
+    memset(a, 0xAA, 256*4096);
+    exit();
+  }
+  wait();
+  // give idle CPUs time to zero freed pages
+  sleep(5);
+  a = sbrk(256*4096);
+  if(a == (char*)0xffffffff){
+    printf(stdout, "zero test sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < 256*4096; i++){
+    if(a[i] != 0){
+      printf(stdout, "zero test: page not zeroed\n");
+      exit();
+    }
+  }
+  sbrk(-256*4096);
+
+  if(pipe(fds) != 0){
+    printf(stdout, "zero test pipe failed\n");
+    exit();
+  }
+  a = sbrk(4096);
+  write(fds[1], "0123456789", 10);
+  if(read(fds[0], a + 100, 10) != 10){
+    printf(stdout, "zero test read failed\n");
+    exit();
+  }
+  for(i = 0; i < 4096; i++){
+    if(a[i] != (i >= 100 && i < 110 ? '0' + i - 100 : 0)){
+      printf(stdout, "zero test: read() page not zeroed\n");
+      exit();
+    }
+  }
+  sbrk(-4096);
+  close(fds[0]);
+  close(fds[1]);
+  printf(stdout, "zero test OK\n");
+}
+
+// Page faults that mapped a whole 4MB page, on all CPUs.
+uint
+lpgfaults(void)
+{
+  uint n;
+  int i;
+
+  vmstat(&st);
+  n = 0;
+  for(i = 0; i < st.ncpu; i++)
+    n += st.cpu[i].lpgfaults;
+  return n;
+}
+
+// can the buddy allocator hand out a physically contiguous
+// 4MB block, and does the block merge back whole when freed?
+void
+buddytest(void)
+{
+  uint faults, before;
+  char *a, *big;
+  int i;
+
+  printf(stdout, "buddy test\n");
+  faults = lpgfaults();
+  before = st.freeblocks[MAXORDER];
+  largepages(1);
+  a = sbrk(8*1024*1024);
+  if(a == (char*)0xffffffff){
+    printf(stdout, "buddy test sbrk failed\n");
+    exit();
+  }
+  big = (char*)(((uint)a + 4096*1024 - 1) & ~(4096*1024 - 1));
+  for(i = 0; i < 4096*1024; i += 4096)
+    big[i] = i / 4096;
+  if(lpgfaults() == faults){
+    printf(stdout, "buddy test: no 4MB block allocated\n");
+    exit();
+  }
+  for(i = 0; i < 4096*1024; i += 4096){
+    if(big[i] != (char)(i / 4096)){
+      printf(stdout, "buddy test: wrong data\n");
+      exit();
+    }
+  }
+  sbrk(-(sbrk(0) - a));
+  largepages(0);
+  vmstat(&st);
+  if(st.freeblocks[MAXORDER] < before){
+    printf(stdout, "buddy test: freed block did not merge\n");
+    exit();
+  }
+  printf(stdout, "buddy test OK\n");
+}
+
+// The slab cache called name, as meminfo reports it.
+struct slabinfo*
+slab(char *name)
+{
+  int i;
+
+  freepages();
+  for(i = 0; i < mi.nslab; i++)
+    if(strcmp(mi.slab[i].name, name) == 0)
+      return &mi.slab[i];
+  printf(stdout, "no slab cache %s\n", name);
+  exit();
+}
+
+// do slab caches give their objects back, and does the inode
+// cache keep a closed file's inode for the next open(), but
+// not the inode of a file that was removed?
+void
+slabtest(void)
+{
+  int fds[2], fd, i;
+  uint n0, n1, pipeslabs;
+
+  printf(stdout, "slab test\n");
+  pipeslabs = slab("pipe")->nslabs;
+  for(i = 0; i < 100; i++){
+    if(pipe(fds) != 0){
+      printf(stdout, "slab test pipe failed\n");
+      exit();
+    }
+    close(fds[0]);
+    close(fds[1]);
+  }
+  if(slab("pipe")->nslabs > pipeslabs + 1){
+    printf(stdout, "slab test: pipes leaked\n");
+    exit();
+  }
+
+  n0 = slab("inode")->nobjs;
+  fd = open("slabfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "slab test create failed\n");
+    exit();
+  }
+  close(fd);
+  n1 = slab("inode")->nobjs;
+  if(n1 != n0 + 1){
+    printf(stdout, "slab test: closed inode not cached\n");
+    exit();
+  }
+  fd = open("slabfile", O_RDONLY);
+  close(fd);
+  if(fd < 0 || slab("inode")->nobjs != n1){
+    printf(stdout, "slab test: cached inode not reused\n");
+    exit();
+  }
+  unlink("slabfile");
+  if(slab("inode")->nobjs != n0){
+    printf(stdout, "slab test: removed inode still cached\n");
+    exit();
+  }
+  printf(stdout, "slab test OK\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  printf(stdout, "memtests starting\n");
+
+  buddytest();
+  kcachetest();
+  zerotest();
+  slabtest();
+
+  printf(stdout, "ALL MEM TESTS PASSED\n");
+  exit();
+}
@@ -0,0 +1,255 @@
+// Memory-mapped files.
+//
+// mmap() reserves a range of the address space between
+// MMAPBASE and SHMBASE for part of a file and records it in
+// one of the process's vma slots; nothing is read yet.  The
+// first touch of each page faults, and mmapfault() reads the
+// page from the file through the buffer cache.  Mappings are
+// shared: munmap(), exec() and exit() write the pages the
+// process dirtied back to the file through the log.  Parts of
+// pages past the end of the file read as zero and are not
+// written back.  Mapped pages are copies, so a write() to the
+// file is not seen by pages that are already mapped.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+
+static struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NMMAP]; v++)
+    if(v->file && va >= v->start && va - v->start < v->len)
+      return v;
+  return 0;
+}
+
+// Map len bytes of file f, starting at page-aligned offset off,
+// into the current process.  Returns the address of the
+// mapping, or -1.
+int
+mmap(struct file *f, uint off, uint len, int prot)
+{
+  struct proc *curproc = myproc();
+  struct vma *v, *empty;
+  uint start;
+  int i;
+
+  if(f->type != FD_INODE || !f->readable || off % PGSIZE)
+    return -1;
+  if((prot & PROT_WRITE) && !f->writable)
+    return -1;
+  if(len == 0 || len > SHMBASE - MMAPBASE)
+    return -1;
+  ilock(f->ip);
+  i = f->ip->type;
+  iunlock(f->ip);
+  if(i != T_FILE)
+    return -1;
+  len = PGROUNDUP(len);
+
+  empty = 0;
+  for(v = curproc->vma; v < &curproc->vma[NMMAP]; v++)
+    if(v->file == 0){
+      empty = v;
+      break;
+    }
+  if(empty == 0)
+    return -1;
+
+  // Take the lowest gap that fits.
+  start = MMAPBASE;
+  for(i = 0; i < NMMAP; i++){
+    v = &curproc->vma[i];
+    if(v->file && start < v->start + v->len && v->start < start + len){
+      start = v->start + v->len;
+      i = -1;
+    }
+  }
+  if(start + len > SHMBASE)
+    return -1;
+
+  empty->start = start;
+  empty->len = len;
+  empty->off = off;
+  empty->prot = prot;
+  empty->file = filedup(f);
+  return start;
+}
+
+// Read in the page at va of a file mapping of p.
+// Returns -1 if va is not mapped or err is a write
+// to a read-only mapping.
+int
+mmapfault(struct proc *p, uint va, uint err)
+{
+  struct vma *v;
+  struct inode *ip;
+  char *mem;
+  uint off, n;
+  int perm;
+
+  if((v = findvma(p, va)) == 0)
+    return -1;
+  if((err & FEC_WR) && !(v->prot & PROT_WRITE))
+    return -1;
+  if((mem = allocuser(1)) == 0)
+    return -1;
+  ip = v->file->ip;
+  off = v->off + (va - v->start);
+  ilock(ip);
+  if(off < ip->size){
+    n = ip->size - off;
+    if(n > PGSIZE)
+      n = PGSIZE;
+    if(readi(ip, mem, off, n) != n){
+      iunlock(ip);
+      kfree(mem);
+      return -1;
+    }
+  }
+  iunlock(ip);
+
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(mapshared(p->pgdir, va, &mem, 1, perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  kfree(mem);  // the mapping holds it now
+  return 0;
+}
+
+// Write the page mem mapped at va back to v's file,
+// a few blocks per transaction like filewrite().
+static void
+writeback(struct vma *v, uint va, char *mem)
+{
+  struct inode *ip = v->file->ip;
+  uint max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  uint off, i, n;
+
+  off = v->off + (va - v->start);
+  for(i = 0; i < PGSIZE; i += n){
+    begin_op();
+    ilock(ip);
+    if(off + i >= ip->size){
+      iunlock(ip);
+      end_op();
+      break;
+    }
+    n = ip->size - (off + i);
+    if(n > PGSIZE - i)
+      n = PGSIZE - i;
+    if(n > max)
+      n = max;
+    writei(ip, mem + i, off + i, n);
+    iunlock(ip);
+    end_op();
+  }
+}
+
+// Write back v's dirty pages and remove it from p.
+// The caller flushes the TLB.
+static void
+unmapvma(struct proc *p, struct vma *v)
+{
+  uint a, flags;
+  char *mem;
+
+  if(v->prot & PROT_WRITE){
+    for(a = v->start; a < v->start + v->len; a += PGSIZE)
+      if((mem = uvapage(p->pgdir, a, &flags)) != 0 && (flags & PTE_D))
+        writeback(v, a, mem);
+  }
+  deallocuvm(p->pgdir, v->start + v->len, v->start);
+  fileclose(v->file);
+  v->file = 0;
+}
+
+// Remove the mapping at addr of the current process, which
+// must cover len bytes.
+int
+munmap(uint addr, uint len)
+{
+  struct proc *curproc = myproc();
+  struct vma *v;
+
+  v = findvma(curproc, addr);
+  if(v == 0 || v->start != addr || PGROUNDUP(len) != v->len)
+    return -1;
+  unmapvma(curproc, v);
+  flushtlb(curproc->pgdir);
+  return 0;
+}
+
+// Remove all of p's mappings, from exec() or exit().
+void
+munmapall(struct proc *p)
+{
+  struct vma *v;
+  int n;
+
+  n = 0;
+  for(v = p->vma; v < &p->vma[NMMAP]; v++){
+    if(v->file){
+      unmapvma(p, v);
+      n++;
+    }
+  }
+  if(n && p == myproc())
+    flushtlb(p->pgdir);
+}
+
+// Give child np the parent's mappings, sharing the pages
+// the parent has already read in.
+int
+mmapfork(struct proc *np, struct proc *parent)
+{
+  struct vma *v, *nv;
+  uint a, flags;
+  char *mem;
+
+  for(v = parent->vma; v < &parent->vma[NMMAP]; v++){
+    if(v->file == 0)
+      continue;
+    nv = &np->vma[v - parent->vma];
+    *nv = *v;
+    nv->file = filedup(v->file);
+    for(a = v->start; a < v->start + v->len; a += PGSIZE){
+      if((mem = uvapage(parent->pgdir, a, &flags)) == 0)
+        continue;
+      if(mapshared(np->pgdir, a, &mem, 1, flags & (PTE_W|PTE_U)) < 0){
+        munmapall(np);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+// Is [va, va+n) inside one of p's mappings, and a writable
+// one if write is set?
+int
+mmapvalid(struct proc *p, uint va, uint n, int write)
+{
+  struct vma *v;
+
+  if((v = findvma(p, va)) == 0 || n > v->start + v->len - va)
+    return 0;
+  if(write && !(v->prot & PROT_WRITE))
+    return 0;
+  return 1;
+}
@@ -2,13 +2,26 @@
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define NBUF         (MAXOPBLOCKS*3)  // disk block cache buffers kept under memory pressure
+#define BCACHEPAGES   128  // most pages of memory the disk block cache may use
+#define FSSIZE       2000  // size of file system in blocks
+#define SWAPBLOCKS   4096  // size of the swap area after the file system, in blocks
+#define AGINGTICKS   4000  // ticks a queued proc waits before moving up a level
+#define NSCHEDHIST     20  // buckets in the scheduler latency histograms
+#define MAXQUANTUM    100  // longest time slice of a scheduling queue, in ticks
+#define NSLEEPQ        61  // buckets in the sleep channel hash table
+#define NBUCKET        31  // buckets in the buffer cache hash table
+#define RAMAX          64  // most blocks read ahead of a sequential reader
+#define NSEG            4  // max loadable segments in a program
+#define MAXORDER       10  // largest kalloc_order() block is 2^MAXORDER pages
+#define NSHM           16  // shared memory segments per system
+#define NSHMATT         4  // shared memory segments attached per process
+#define SHMMAXPG       64  // max pages in a shared memory segment
+#define NMMAP           8  // file mappings per process
+#define NPIN   (MAXARG+4)  // user buffers a system call keeps from being swapped out
 
@@ -4,26 +4,95 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
+#include "traps.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "schedstat.h"
+#include "meminfo.h"
+
+// added for lab3
+// Every CPU has its own run queue, with one structure per
+// scheduling level.  Only RUNNABLE processes are queued, so picking
+// the next process never has to walk the whole process table:
+//   1: round robin, FIFO list
+//   2: LCFS, max-heap ordered by arrival_time
+//   3: MHRRN, max-heap on a cached fixed-point MHRRN score
+//
+// A process belongs to the run queue of p->rq_cpu, and that queue's
+// lock protects its run state.  The lock is held across the switch
+// into and out of a process, the way ptable.lock used to be.
+// ptable.lock only guards allocation and parent/child bookkeeping.
+// Lock order: ptable.lock or the lock passed to sleep(), then a
+// sleep queue lock, then a run queue lock; two run queue locks are
+// taken in CPU order.
+struct proclist {
+  struct proc *head;
+  struct proc *tail;
+};
+
+struct procheap {
+  int n;
+  int (*before)(struct proc*, struct proc*);
+  struct proc *a[NPROC];
+};
+
+struct runqueue {
+  struct spinlock lock;
+  struct proclist rr;
+  struct procheap lcfs;
+  struct procheap mhrrn;
+  uint mhrrn_ticks;            // ticks when MHRRN scores were refreshed
+  struct proc *age_head;       // Queued level 2 and 3 procs, oldest first
+  struct proc *age_tail;
+  int nrunnable;               // Number of queued processes
+  int nallowed[NCPU];          // Queued processes each CPU may run
+};
 
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
 } ptable;
 
+static struct runqueue runqueues[NCPU];
+
+// Sleeping processes wait on a sleep queue, hashed by the
+// channel they sleep on, so wakeup() only looks at processes
+// whose channel hashes to the same bucket.  A sleeping process
+// is on no run queue, so the queue reuses the run queue links.
+struct sleepq {
+  struct spinlock lock;
+  struct proclist procs;
+};
+
+static struct sleepq sleepqs[NSLEEPQ];
+
+// Time slice of each scheduling queue, in timer ticks.
+// Indexed by scheduler_queue.
+static int quantum[4] = { 0, 1, 1, 1 };
+
 static struct proc *initproc;
 
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
+static int lcfs_before(struct proc*, struct proc*);
+static int mhrrn_before(struct proc*, struct proc*);
 
 void
 pinit(void)
 {
+  struct runqueue *rq;
+  struct sleepq *sq;
+
   initlock(&ptable.lock, "ptable");
+  for(rq = runqueues; rq < &runqueues[NCPU]; rq++){
+    initlock(&rq->lock, "runqueue");
+    rq->lcfs.before = lcfs_before;
+    rq->mhrrn.before = mhrrn_before;
+  }
+  for(sq = sleepqs; sq < &sleepqs[NSLEEPQ]; sq++)
+    initlock(&sq->lock, "sleepq");
 }
 
 // Must be called with interrupts disabled
@@ -65,6 +134,383 @@ myproc(void) {
   return p;
 }
 
+//PAGEBREAK: 40
+// Run queue operations.  The run queue's lock must be held.
+
+static void
+list_push(struct proclist *l, struct proc *p)
+{
+  p->rq_next = 0;
+  p->rq_prev = l->tail;
+  if(l->tail)
+    l->tail->rq_next = p;
+  else
+    l->head = p;
+  l->tail = p;
+}
+
+static void
+list_remove(struct proclist *l, struct proc *p)
+{
+  if(p->rq_prev)
+    p->rq_prev->rq_next = p->rq_next;
+  else
+    l->head = p->rq_next;
+  if(p->rq_next)
+    p->rq_next->rq_prev = p->rq_prev;
+  else
+    l->tail = p->rq_prev;
+  p->rq_next = p->rq_prev = 0;
+}
+
+static void
+heap_swap(struct procheap *h, int i, int j)
+{
+  struct proc *t;
+
+  t = h->a[i];
+  h->a[i] = h->a[j];
+  h->a[j] = t;
+  h->a[i]->heap_index = i;
+  h->a[j]->heap_index = j;
+}
+
+static void
+heap_up(struct procheap *h, int i)
+{
+  while(i > 0 && h->before(h->a[i], h->a[(i-1)/2])){
+    heap_swap(h, i, (i-1)/2);
+    i = (i-1)/2;
+  }
+}
+
+static void
+heap_down(struct procheap *h, int i)
+{
+  int c;
+
+  for(;;){
+    c = 2*i + 1;
+    if(c >= h->n)
+      break;
+    if(c+1 < h->n && h->before(h->a[c+1], h->a[c]))
+      c++;
+    if(!h->before(h->a[c], h->a[i]))
+      break;
+    heap_swap(h, i, c);
+    i = c;
+  }
+}
+
+static void
+heap_push(struct procheap *h, struct proc *p)
+{
+  if(h->n >= NPROC)
+    panic("heap_push");
+  p->heap_index = h->n;
+  h->a[h->n++] = p;
+  heap_up(h, p->heap_index);
+}
+
+static void
+heap_remove(struct procheap *h, struct proc *p)
+{
+  int i;
+
+  i = p->heap_index;
+  h->n--;
+  if(i != h->n){
+    h->a[i] = h->a[h->n];
+    h->a[i]->heap_index = i;
+    heap_up(h, i);
+    heap_down(h, i);
+  }
+  p->heap_index = -1;
+}
+
+// Restore the heap order around p after its key changed.
+static void
+heap_fix(struct procheap *h, struct proc *p)
+{
+  heap_up(h, p->heap_index);
+  heap_down(h, p->heap_index);
+}
+
+// LCFS runs the latest arrival first; ties go to the newer pid.
+static int
+lcfs_before(struct proc *a, struct proc *b)
+{
+  if(a->arrival_time != b->arrival_time)
+    return a->arrival_time > b->arrival_time;
+  return a->pid > b->pid;
+}
+
+// The aging list holds the queued level 2 and 3 processes in
+// enqueue_time order, so the head is the longest waiter.  A
+// process that has just become runnable goes at the tail; one
+// moved from another run queue keeps its enqueue_time, and is
+// placed by it.
+static void
+age_push(struct runqueue *rq, struct proc *p)
+{
+  struct proc *q;
+
+  for(q = rq->age_tail; q && (int)(q->enqueue_time - p->enqueue_time) > 0; q = q->age_prev)
+    ;
+  p->age_prev = q;
+  p->age_next = q ? q->age_next : rq->age_head;
+  if(p->age_next)
+    p->age_next->age_prev = p;
+  else
+    rq->age_tail = p;
+  if(q)
+    q->age_next = p;
+  else
+    rq->age_head = p;
+}
+
+static void
+age_remove(struct runqueue *rq, struct proc *p)
+{
+  if(p->age_prev)
+    p->age_prev->age_next = p->age_next;
+  else
+    rq->age_head = p->age_next;
+  if(p->age_next)
+    p->age_next->age_prev = p->age_prev;
+  else
+    rq->age_tail = p->age_prev;
+  p->age_next = p->age_prev = 0;
+}
+
+// MHRRN score of p in 16.16 fixed point:
+//   ((waiting + executed) / executed + HRRNPriority) / 2
+// where waiting is the time since arrival.  Keeping the
+// fraction avoids the ties integer division used to produce.
+static int
+mhrrn_score(struct proc *p)
+{
+  uint w, e, q, r, hrrn;
+  int prio;
+
+  w = ticks - p->arrival_time;
+  e = p->executed_cycles;
+  q = w / e;
+  r = w % e;
+  if(q > 0x7ffe)
+    q = 0x7ffe;
+  // Keep r << 16 from overflowing.
+  while(e >= 0x10000){
+    e >>= 1;
+    r >>= 1;
+  }
+  hrrn = ((q + 1) << 16) + (r << 16) / e;
+
+  prio = p->HRRNPriority;
+  if(prio > 0x7fff)
+    prio = 0x7fff;
+  if(prio < -0x7fff)
+    prio = -0x7fff;
+  return (int)(hrrn / 2) + prio * 0x8000;
+}
+
+// MHRRN runs the highest score first; ties go to the older pid.
+static int
+mhrrn_before(struct proc *a, struct proc *b)
+{
+  if(a->mhrrn_score != b->mhrrn_score)
+    return a->mhrrn_score > b->mhrrn_score;
+  return a->pid < b->pid;
+}
+
+// Scores of waiting processes grow with ticks, so the cached
+// scores on rq are recomputed and the heap rebuilt once per tick.
+static void
+mhrrn_refresh(struct runqueue *rq)
+{
+  struct procheap *h;
+  int i;
+
+  h = &rq->mhrrn;
+  for(i = 0; i < h->n; i++)
+    h->a[i]->mhrrn_score = mhrrn_score(h->a[i]);
+  for(i = h->n/2 - 1; i >= 0; i--)
+    heap_down(h, i);
+  rq->mhrrn_ticks = ticks;
+}
+
+// Can p run on CPU id?  A queued process's mask must not change
+// while it is queued, since rq->nallowed counts it.
+static int
+allowed(struct proc *p, int id)
+{
+  return (p->affinity >> id) & 1;
+}
+
+static void
+rq_add(struct runqueue *rq, struct proc *p)
+{
+  int i;
+
+  if(p->rq_level)
+    panic("rq_add");
+  switch(p->scheduler_queue){
+  case 1:
+    list_push(&rq->rr, p);
+    break;
+  case 2:
+    heap_push(&rq->lcfs, p);
+    break;
+  case 3:
+    p->mhrrn_score = mhrrn_score(p);
+    heap_push(&rq->mhrrn, p);
+    break;
+  default:
+    panic("rq_add queue");
+  }
+  p->rq_level = p->scheduler_queue;
+  if(p->rq_level > 1)
+    age_push(rq, p);
+  rq->nrunnable++;
+  for(i = 0; i < ncpu; i++)
+    if(allowed(p, i))
+      rq->nallowed[i]++;
+}
+
+static void
+rq_remove(struct runqueue *rq, struct proc *p)
+{
+  int i;
+
+  if(p->rq_level > 1)
+    age_remove(rq, p);
+  switch(p->rq_level){
+  case 1:
+    list_remove(&rq->rr, p);
+    break;
+  case 2:
+    heap_remove(&rq->lcfs, p);
+    break;
+  case 3:
+    heap_remove(&rq->mhrrn, p);
+    break;
+  default:
+    panic("rq_remove");
+  }
+  p->rq_level = 0;
+  rq->nrunnable--;
+  for(i = 0; i < ncpu; i++)
+    if(allowed(p, i))
+      rq->nallowed[i]--;
+}
+
+// Mark p RUNNABLE and queue it on the level it belongs to.
+static void
+setrunnable(struct runqueue *rq, struct proc *p)
+{
+  p->state = RUNNABLE;
+  p->queuedtsc = rdtsc();
+  p->enqueue_time = ticks;
+  rq_add(rq, p);
+}
+
+// Histogram bucket for a duration of t TSC cycles.
+static int
+histbucket(uint64 t)
+{
+  int b;
+
+  t >>= SCHEDHIST_SHIFT;
+  for(b = 0; t > 1 && b < NSCHEDHIST-1; b++)
+    t >>= 1;
+  return b;
+}
+
+// Lock and return the run queue p belongs to.  p->rq_cpu
+// may change under us while p is being stolen, so check it
+// again once the lock is held.
+static struct runqueue*
+lockrq(struct proc *p)
+{
+  struct runqueue *rq;
+
+  for(;;){
+    rq = &runqueues[p->rq_cpu];
+    acquire(&rq->lock);
+    if(rq == &runqueues[p->rq_cpu])
+      return rq;
+    release(&rq->lock);
+  }
+}
+
+// Wake a halted CPU to run p, just queued on CPU p->rq_cpu:
+// that CPU if it is idle, otherwise any idle CPU p may run on,
+// which will steal it.  A CPU sets idle before its last look at
+// the run queues and the queueing CPU has bumped nallowed
+// before looking at idle, so one of them sees the other.
+static void
+kick(struct proc *p)
+{
+  struct cpu *c;
+
+  __sync_synchronize();
+  c = &cpus[p->rq_cpu];
+  if(!c->idle){
+    for(c = cpus; c < &cpus[ncpu]; c++)
+      if(c->idle && allowed(p, c - cpus))
+        break;
+    if(c == &cpus[ncpu])
+      return;
+  }
+  c->kicktsc = (uint)rdtsc();
+  lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+}
+
+// Is any process that CPU id may run queued on any CPU?
+static int
+anyrunnable(int id)
+{
+  int i;
+
+  for(i = 0; i < ncpu; i++)
+    if(runqueues[i].nallowed[id])
+      return 1;
+  return 0;
+}
+
+// The CPU in mask with the fewest queued processes, which is
+// where new and migrating processes go.  The counts are read
+// without locks; they are only a hint.
+static int
+idlestcpu(uint mask)
+{
+  int i, best;
+
+  best = -1;
+  for(i = 0; i < ncpu; i++){
+    if(!(mask & (1 << i)))
+      continue;
+    if(best < 0 || runqueues[i].nrunnable < runqueues[best].nrunnable)
+      best = i;
+  }
+  return best;
+}
+
+// Queue p, just taken off rq, on a CPU its affinity allows.
+// Called with rq locked and returns with it released: the
+// target's lock may come first in CPU order.  Meanwhile p has
+// rq_level 0, which every lockrq() user treats as not queued.
+static void
+migrate(struct runqueue *rq, struct proc *p)
+{
+  p->rq_cpu = idlestcpu(p->affinity);
+  release(&rq->lock);
+  rq = lockrq(p);
+  rq_add(rq, p);
+  release(&rq->lock);
+  kick(p);
+}
+
 //PAGEBREAK: 32
 // Look in the process table for an UNUSED proc.
 // If found, change state to EMBRYO and initialize
@@ -75,6 +521,7 @@ allocproc(void)
 {
   struct proc *p;
   char *sp;
+  int i;
 
   acquire(&ptable.lock);
 
@@ -96,6 +543,7 @@ found:
     p->state = UNUSED;
     return 0;
   }
+  kcharge(p->kstack, MEM_KSTACK);
   sp = p->kstack + KSTACKSIZE;
 
   // Leave room for trap frame.
@@ -117,6 +565,15 @@ found:
   p->arrival_time = ticks;
   p->executed_cycles = 1;
   p->HRRNPriority = 0;
+  p->rq_level = 0;
+  p->heap_index = -1;
+  p->timer_index = -1;
+  for(i = 0; i < NSHMATT; i++)
+    p->shm[i] = -1;
+  memset(p->vma, 0, sizeof p->vma);
+  memset(p->waithist, 0, sizeof p->waithist);
+  memset(p->slicehist, 0, sizeof p->slicehist);
+  memset(p->promotions, 0, sizeof p->promotions);
 
   return p;
 }
@@ -127,6 +584,7 @@ void
 userinit(void)
 {
   struct proc *p;
+  struct runqueue *rq;
   extern char _binary_initcode_start[], _binary_initcode_size[];
 
   p = allocproc();
@@ -152,11 +610,14 @@ userinit(void)
   // run this process. the acquire forces the above
   // writes to be visible, and the lock is also needed
   // because the assignment might not be atomic.
-  acquire(&ptable.lock);
+  p->affinity = (1 << ncpu) - 1;
+  p->rq_cpu = idlestcpu(p->affinity);
+  rq = lockrq(p);
 
-  p->state = RUNNABLE;
+  setrunnable(rq, p);
 
-  release(&ptable.lock);
+  release(&rq->lock);
+  kick(p);
 }
 
 // Grow current process's memory by n bytes.
@@ -169,10 +630,18 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    // Only reserve the address space; pagefault() allocates
+    // each page when it is first touched.
+    if(sz + n < sz || sz + n > MMAPBASE)
       return -1;
+    sz += n;
   } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    // No preemption while our PTEs change: swapvictim() only
+    // looks at processes that are not running.
+    pushcli();
+    sz = deallocuvm(curproc->pgdir, sz, sz + n);
+    popcli();
+    if(sz == 0)
       return -1;
   }
   curproc->sz = sz;
@@ -180,6 +649,42 @@ growproc(int n)
   return 0;
 }
 
+// Pick a user page for swapout(), moving a clock hand over
+// the pages of each process in turn.  Only processes that are
+// not running are looked at: they hold no TLB entries, and
+// their run queue lock keeps them from starting while the PTE
+// changes.  Returns the page, with its new swap slot in *slot,
+// or 0 if there is nothing to take.
+char*
+swapvictim(int *slot)
+{
+  static int hand;
+  static uint handva;
+  struct proc *p;
+  struct runqueue *rq;
+  char *mem;
+  int n;
+
+  mem = 0;
+  acquire(&ptable.lock);
+  // The first pass over a process may only clear PTE_A bits.
+  for(n = 0; n <= 2*NPROC && mem == 0; n++){
+    p = &ptable.proc[hand];
+    if(p->state == SLEEPING || p->state == RUNNABLE){
+      rq = lockrq(p);
+      if(p->state == SLEEPING || p->state == RUNNABLE)
+        mem = clockscan(p, &handva, slot);
+      release(&rq->lock);
+    }
+    if(mem == 0){
+      hand = (hand + 1) % NPROC;
+      handva = 0;
+    }
+  }
+  release(&ptable.lock);
+  return mem;
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
@@ -188,6 +693,7 @@ fork(void)
 {
   int i, pid;
   struct proc *np;
+  struct runqueue *rq;
   struct proc *curproc = myproc();
 
   // Allocate process.
@@ -195,8 +701,21 @@ fork(void)
     return -1;
   }
 
-  // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+  // Copy process state from proc.  No preemption while
+  // copyuvm() changes our PTEs; see growproc().
+  pushcli();
+  np->pgdir = copyuvm(curproc->pgdir, curproc->sz);
+  popcli();
+  if(np->pgdir == 0){
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+  if(shmfork(np, curproc) < 0 || mmapfork(np, curproc) < 0){
+    shmdetachall(np);
+    freevm(np->pgdir);
+    np->pgdir = 0;
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
@@ -213,16 +732,23 @@ fork(void)
     if(curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
+  np->exe = curproc->exe ? idup(curproc->exe) : 0;
+  np->nseg = curproc->nseg;
+  np->largepages = curproc->largepages;
+  memmove(np->seg, curproc->seg, sizeof(np->seg));
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
   pid = np->pid;
 
-  acquire(&ptable.lock);
+  np->affinity = curproc->affinity;
+  np->rq_cpu = idlestcpu(np->affinity);
+  rq = lockrq(np);
 
-  np->state = RUNNABLE;
+  setrunnable(rq, np);
 
-  release(&ptable.lock);
+  release(&rq->lock);
+  kick(np);
 
   return pid;
 }
@@ -240,6 +766,9 @@ exit(void)
   if(curproc == initproc)
     panic("init exiting");
 
+  munmapall(curproc);
+  shmdetachall(curproc);
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
@@ -250,25 +779,32 @@ exit(void)
 
   begin_op();
   iput(curproc->cwd);
+  if(curproc->exe)
+    iput(curproc->exe);
   end_op();
   curproc->cwd = 0;
+  curproc->exe = 0;
 
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
+  wakeup(curproc->parent);
 
   // Pass abandoned children to init.
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->parent == curproc){
       p->parent = initproc;
       if(p->state == ZOMBIE)
-        wakeup1(initproc);
+        wakeup(initproc);
     }
   }
 
   // Jump into the scheduler, never to return.
+  // Our run queue lock is held until the switch is done,
+  // which keeps wait() from freeing the stack under us.
+  lockrq(curproc);
   curproc->state = ZOMBIE;
+  release(&ptable.lock);
   sched();
   panic("zombie exit");
 }
@@ -279,6 +815,7 @@ int
 wait(void)
 {
   struct proc *p;
+  struct runqueue *rq;
   int havekids, pid;
   struct proc *curproc = myproc();
   
@@ -291,7 +828,10 @@ wait(void)
         continue;
       havekids = 1;
       if(p->state == ZOMBIE){
-        // Found one.
+        // Found one.  Wait for it to finish switching away
+        // before freeing its kernel stack.
+        rq = lockrq(p);
+        release(&rq->lock);
         pid = p->pid;
         kfree(p->kstack);
         p->kstack = 0;
@@ -312,7 +852,7 @@ wait(void)
       return -1;
     }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
+    // Wait for children to exit.  (See wakeup call in exit.)
     sleep(curproc, &ptable.lock);  //DOC: wait-sleep
   }
 }
@@ -349,51 +889,181 @@ int num_of_digits(int num)
   return ans;
 }
 
+// Set p's HRRN priority and refresh its cached score.
+static void
+set_HRRN_priority(struct proc *p, int priority)
+{
+  struct runqueue *rq;
+
+  rq = lockrq(p);
+  p->HRRNPriority = priority;
+  if(p->rq_level == 3){
+    p->mhrrn_score = mhrrn_score(p);
+    heap_fix(&rq->mhrrn, p);
+  }
+  release(&rq->lock);
+}
+
 void 
 set_HRRN_priority_proc(int pid, int priority)
 {
   struct proc* p;
+  acquire(&ptable.lock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
   {
     if(p->pid == pid)
     {
-      p->HRRNPriority = priority;
+      set_HRRN_priority(p, priority);
       break;
     }
   }
+  release(&ptable.lock);
 }
 
 void 
 set_HRRN_priority_sys(int priority)
 {
   struct proc* p;
+  acquire(&ptable.lock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
   {
     if(p->pid > 0)
     {
-      p->HRRNPriority = priority;
+      set_HRRN_priority(p, priority);
     }
   }
+  release(&ptable.lock);
+}
+
+// Move p to another scheduling level, re-queueing it
+// if it is currently waiting to run.
+// The lock of p's run queue must be held.
+static void
+requeue(struct runqueue *rq, struct proc *p, int scheduler_queue)
+{
+  if(p->rq_level){
+    rq_remove(rq, p);
+    p->scheduler_queue = scheduler_queue;
+    p->enqueue_time = ticks;
+    rq_add(rq, p);
+  } else
+    p->scheduler_queue = scheduler_queue;
+}
+
+void
+set_queue_quantum(int scheduler_queue, int nticks)
+{
+  quantum[scheduler_queue] = nticks;
+}
+
+// Called on each timer tick taken while p is running.
+// Returns 1 once p has used up its queue's time slice.
+int
+slice_expired(struct proc *p)
+{
+  return ++p->slice_ticks >= quantum[p->scheduler_queue];
 }
 
 void
 set_schedule_queue(int pid, int scheduler_queue)
 {
   struct proc *p;
+  struct runqueue *rq;
+  acquire(&ptable.lock);
   for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
     if(p->pid == pid)
     {
-      p->scheduler_queue = scheduler_queue;
+      rq = lockrq(p);
+      requeue(rq, p, scheduler_queue);
+      release(&rq->lock);
+      if(p->rq_level)
+        kick(p);
+      break;
+    }
+  release(&ptable.lock);
+}
+
+// Restrict pid to the CPUs in mask, bit i standing for CPU i.
+// A queued process that may no longer run where it is queued
+// moves now; a running one moves the next time it is picked.
+int
+set_affinity(int pid, uint mask)
+{
+  struct proc *p;
+  struct runqueue *rq;
+
+  mask &= (1 << ncpu) - 1;
+  if(mask == 0)
+    return -1;
+  acquire(&ptable.lock);
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->pid == pid && p->state != UNUSED)
+    {
+      rq = lockrq(p);
+      if(p->rq_level){
+        rq_remove(rq, p);
+        p->affinity = mask;
+        if(allowed(p, p->rq_cpu)){
+          rq_add(rq, p);
+          release(&rq->lock);
+        } else
+          migrate(rq, p);
+      } else {
+        p->affinity = mask;
+        if(p->state == SLEEPING && !allowed(p, p->rq_cpu))
+          p->rq_cpu = idlestcpu(mask);
+        release(&rq->lock);
+      }
+      release(&ptable.lock);
+      return 0;
+    }
+  release(&ptable.lock);
+  return -1;
+}
+
+int
+get_affinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  mask = -1;
+  acquire(&ptable.lock);
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->pid == pid && p->state != UNUSED)
+    {
+      mask = p->affinity;
       break;
     }
+  release(&ptable.lock);
+  return mask;
+}
+
+// Print a 16.16 fixed-point value with two decimals.
+static void
+print_fixed(int x)
+{
+  if(x < 0){
+    cprintf("-");
+    x = -x;
+  }
+  cprintf("%d.", x >> 16);
+  x = ((x & 0xffff) * 100) >> 16;
+  if(x < 10)
+    cprintf("0");
+  cprintf("%d", x);
 }
 
 void
 print_info(void)
 { 
   struct proc *p;
-  cprintf("name     pid   state queue_level  cycle       arrival    HRRNPriority  MHRRN\n");
-  cprintf("..............................................................................\n");
+  int rsspages;
+  cprintf("quantum (ticks): queue 1: %d, queue 2: %d, queue 3: %d\n\n", quantum[1], quantum[2], quantum[3]);
+  cprintf("name     pid   state queue_level  cycle       arrival    HRRNPriority  rss       affinity  MHRRN\n");
+  cprintf("..................................................................................................\n");
+
+  acquire(&ptable.lock);
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
 
@@ -414,92 +1084,201 @@ print_info(void)
     for (int i = 0; i < 12 - num_of_digits(p->arrival_time); i++) cprintf(" ");
     cprintf("%d",p->HRRNPriority);
     for (int i = 0; i < 12 - num_of_digits(p->HRRNPriority); i++) cprintf(" ");
-    cprintf("%d\n", ((((ticks-p->arrival_time)+p->executed_cycles)/p->executed_cycles)+p->HRRNPriority)/2);
+    rsspages = p->pgdir ? rss(p->pgdir) : 0;
+    cprintf("%d", rsspages);
+    for (int i = 0; i < 10 - num_of_digits(rsspages); i++) cprintf(" ");
+    cprintf("0x%x", p->affinity);
+    for (int i = 0; i < 8 - (p->affinity < 0x10 ? 1 : 2); i++) cprintf(" ");
+    print_fixed(mhrrn_score(p));
+    cprintf("\n");
+  }
+  release(&ptable.lock);
+  cprintf("\n");
+  for(int i = 0; i < ncpu; i++){
+    cprintf("cpu%d: halts %d, IPI wakeups %d", i, cpus[i].halts, cpus[i].wakeups);
+    if(cpus[i].wakeups)
+      cprintf(", avg wakeup latency %d cycles", cpus[i].wakecycles / cpus[i].wakeups);
+    cprintf("\n");
   }
   cprintf("\n");
 }
 
-struct proc* 
-RR_scheduler(int* index)
+// Head of the RR FIFO.
+static struct proc*
+RR_scheduler(struct runqueue *rq)
 {
-  struct proc *p;
-  int selc_index = -1;
-  int cur_index;
-  for (int i = 0; i < NPROC; i++)
-  {
-    cur_index = (i + (*index)) %  NPROC;  // circular queue
-    if(ptable.proc[cur_index].state != RUNNABLE || ptable.proc[cur_index].scheduler_queue != 1)
-      continue;
+  return rq->rr.head;
+}
 
-    p = &ptable.proc[cur_index];
-    selc_index = cur_index;
-    *index = (cur_index + 1) % NPROC;
-    break;
-  }
-  if (selc_index == -1)
+// Top of the LCFS heap: the latest arrival.
+static struct proc*
+LCFS_scheduler(struct runqueue *rq)
+{
+  if(rq->lcfs.n == 0)
+    return 0;
+  return rq->lcfs.a[0];
+}
+
+// Top of the MHRRN heap: the highest cached score.
+static struct proc*
+MHRRN_scheduler(struct runqueue *rq)
+{
+  if(rq->mhrrn.n == 0)
     return 0;
+  return rq->mhrrn.a[0];
+}
+
+// Take the next process off rq, trying the levels in order.
+static struct proc*
+pickproc(struct runqueue *rq)
+{
+  struct proc *p;
+
+  p = RR_scheduler(rq);
+
+  if (p == 0)
+    p = LCFS_scheduler(rq);
+
+  if (p == 0)
+    p = MHRRN_scheduler(rq);
+
+  if (p != 0)
+    rq_remove(rq, p);
   return p;
 }
 
-struct proc* 
-LCFS_scheduler(void)
+// The first process in h's order that CPU id may run.
+static struct proc*
+heapbest(struct procheap *h, int id)
+{
+  struct proc *best;
+  int i;
+
+  best = 0;
+  for(i = 0; i < h->n; i++)
+    if(allowed(h->a[i], id) && (best == 0 || h->before(h->a[i], best)))
+      best = h->a[i];
+  return best;
+}
+
+// Take the process pickproc() would choose from rq, among the
+// ones CPU id may run.
+static struct proc*
+stealproc(struct runqueue *rq, int id)
 {
   struct proc *p;
-  struct proc* maxArrivalTimeProc = 0;
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-  {
-    if(p->state == RUNNABLE && p->scheduler_queue == 2)
-    {
-      if(maxArrivalTimeProc != 0)
-      {
-        if(p->arrival_time >= maxArrivalTimeProc->arrival_time)
-          maxArrivalTimeProc = p;
-      }
-      else
-        maxArrivalTimeProc = p;
-    }
-    else
+
+  for(p = rq->rr.head; p != 0; p = p->rq_next)
+    if(allowed(p, id))
+      break;
+
+  if (p == 0)
+    p = heapbest(&rq->lcfs, id);
+
+  if (p == 0)
+    p = heapbest(&rq->mhrrn, id);
+
+  if (p != 0)
+    rq_remove(rq, p);
+  return p;
+}
+
+// Move one process from the run queue with the most processes
+// CPU id may run to the run queue of CPU id, which has run
+// dry.  Called without any run queue lock held.  Returns 1 if
+// a process was moved.
+static int
+steal(int id)
+{
+  struct runqueue *rq, *victim;
+  struct proc *p;
+  int i, busiest, moved;
+
+  busiest = -1;
+  for(i = 0; i < ncpu; i++){
+    if(i == id || runqueues[i].nallowed[id] == 0)
       continue;
+    if(busiest < 0 || runqueues[i].nallowed[id] > runqueues[busiest].nallowed[id])
+      busiest = i;
   }
-  if (maxArrivalTimeProc == 0)
+  if(busiest < 0)
     return 0;
-  return maxArrivalTimeProc;
+
+  rq = &runqueues[id];
+  victim = &runqueues[busiest];
+  if(id < busiest){
+    acquire(&rq->lock);
+    acquire(&victim->lock);
+  } else {
+    acquire(&victim->lock);
+    acquire(&rq->lock);
+  }
+  moved = 0;
+  if(rq->nallowed[id] == 0 && (p = stealproc(victim, id)) != 0){
+    p->rq_cpu = id;
+    rq_add(rq, p);
+    cpus[id].steals++;
+    moved = 1;
+  }
+  release(&victim->lock);
+  release(&rq->lock);
+  return moved;
 }
 
-struct proc* 
-MHRRN_scheduler(void)
+// Nothing to run: halt until an interrupt arrives, usually
+// the timer or a reschedule IPI from kick().
+static void
+idle(struct cpu *c)
 {
-  struct proc *p;
-  struct proc* maxMHRRNProc = 0;
-  int waiting_time;
-  int maxMHRRN = -1;
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-  {
-    if(p->state == RUNNABLE && p->scheduler_queue == 3)
-    {
-      if(maxMHRRNProc != 0)
-      {
-        waiting_time = ticks - p->arrival_time;
-        int HRRN = (waiting_time+p->executed_cycles)/p->executed_cycles;
-        int MHRRN = (HRRN+p->HRRNPriority)/2;
-        if(MHRRN > maxMHRRN)
-        {
-          maxMHRRN = MHRRN;
-          maxMHRRNProc = p;
-        }
-      } else {
-        waiting_time = ticks - p->arrival_time;
-        int HRRN = (waiting_time+p->executed_cycles)/p->executed_cycles;
-        maxMHRRN = (HRRN+p->HRRNPriority)/2;
-        maxMHRRNProc = p;
-      }
+  uint t;
+
+  // Spend the time zeroing free pages for kzalloc(), a page at
+  // a time with interrupts on, until there is work or nothing
+  // left to zero.
+  while(!anyrunnable(c - cpus) && kzerofill())
+    ;
+
+  cli();
+  c->idle = 1;
+  __sync_synchronize();
+  if(!anyrunnable(c - cpus)){
+    c->halts++;
+    stihlt();
+    cli();
+    t = c->kicktsc;
+    if(t){
+      c->wakeups++;
+      c->wakecycles += (uint)rdtsc() - t;
+      c->kicktsc = 0;
     }
-    else
-      continue;
   }
-  if (maxMHRRNProc == 0)
-    return 0;
-  return maxMHRRNProc;
+  c->idle = 0;
+}
+
+// Per-tick upkeep of this CPU's run queue, called from the
+// timer interrupt.
+// Processes that have waited AGINGTICKS move up one level, so
+// that lower levels can't starve.  The aging list is oldest
+// first, so this only looks at the processes it promotes; a
+// promoted process goes to the back with a fresh enqueue_time.
+// Then the cached MHRRN scores are brought up to date.
+void
+schedtick(void)
+{
+  struct runqueue *rq;
+  struct proc *p;
+
+  rq = &runqueues[cpuid()];
+  acquire(&rq->lock);
+  if(mycpu()->idle)
+    mycpu()->idleticks++;
+  while((p = rq->age_head) != 0 && ticks - p->enqueue_time > AGINGTICKS){
+    p->promotions[p->scheduler_queue - 1]++;
+    requeue(rq, p, p->scheduler_queue - 1);
+  }
+  if(rq->mhrrn_ticks != ticks)
+    mhrrn_refresh(rq);
+  release(&rq->lock);
 }
 
 //PAGEBREAK: 42
@@ -514,51 +1293,43 @@ void
 scheduler(void)
 {
   struct proc *p;
-  struct proc *pr;
   struct cpu *c = mycpu();
+  int id = cpuid();
+  struct runqueue *rq = &runqueues[id];
+  int level;
+  uint64 now;
   c->proc = 0;
-  int RR_index = 0;
   
   for(;;){
     // Enable interrupts on this processor.
     sti();
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
+    // Pick the next process from this CPU's run queue,
+    // stealing one from another CPU if it is empty.
+    acquire(&rq->lock);
 
-    p = RR_scheduler(&RR_index);
+    p = pickproc(rq);
 
-    if (p == 0)
+    if(p == 0)
     {
-      RR_index = 0;
-      p = LCFS_scheduler();
+      release(&rq->lock);
+      if(!steal(id))
+        idle(c);
+      continue;
     }
-
-    if (p == 0)
-      p = MHRRN_scheduler();
-
-    if(p != 0)
-    {
-      p->executed_cycles++;
-      for(pr = ptable.proc; pr < &ptable.proc[NPROC]; pr++)
-      {
-      if(pr->pid == 0)
-        continue;
-
-      if(pr->state == RUNNABLE)
-        pr->waiting_time++;
-
-      if(pr->waiting_time > 8000)
-      {
-        if(pr->scheduler_queue > 1)
-        {
-          pr->scheduler_queue--;
-          pr->waiting_time = 0;
-        }
-      }
+    if(!allowed(p, id)){
+      // Its affinity changed while it was queued here.
+      migrate(rq, p);
+      continue;
     }
-    p->waiting_time = 0;
+
+    p->executed_cycles++;
+    p->slice_ticks = 0;
+    level = p->scheduler_queue - 1;
+    now = rdtsc();
+    p->waithist[level][histbucket(now - p->queuedtsc)]++;
+    c->switches++;
     // Switch to chosen process.  It is the process's job
-    // to release ptable.lock and then reacquire it
+    // to release its run queue lock and then reacquire it
     // before jumping back to us.
     c->proc = p;
     switchuvm(p);
@@ -566,18 +1337,18 @@ scheduler(void)
 
     swtch(&(c->scheduler), p->context);
     switchkvm();
+    p->slicehist[level][histbucket(rdtsc() - now)]++;
 
     // Process is done running for now.
     // It should have changed its p->state before coming back.
     c->proc = 0;
-    }
-    release(&ptable.lock);
+    release(&rq->lock);
 
   }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
-// and have changed proc->state. Saves and restores
+// Enter scheduler.  Must hold only the lock of this CPU's
+// run queue and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
 // be proc->intena and proc->ncli, but that would
@@ -589,8 +1360,8 @@ sched(void)
   int intena;
   struct proc *p = myproc();
 
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if(!holding(&runqueues[p->rq_cpu].lock))
+    panic("sched runqueue lock");
   if(mycpu()->ncli != 1)
     panic("sched locks");
   if(p->state == RUNNING)
@@ -603,13 +1374,18 @@ sched(void)
 }
 
 // Give up the CPU for one scheduling round.
+// A running process's rq_cpu is the CPU it runs on, and
+// after sched() returns that CPU's scheduler holds the lock.
 void
 yield(void)
 {
-  acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  struct proc *p = myproc();
+  struct runqueue *rq;
+
+  rq = lockrq(p);  //DOC: yieldlock
+  setrunnable(rq, p);
   sched();
-  release(&ptable.lock);
+  release(&runqueues[p->rq_cpu].lock);
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -618,8 +1394,8 @@ void
 forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding the run queue lock from scheduler.
+  release(&runqueues[myproc()->rq_cpu].lock);
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -628,17 +1404,25 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    swapinit(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).
 }
 
+static struct sleepq*
+sleepq(void *chan)
+{
+  return &sleepqs[((uint)chan >> 2) % NSLEEPQ];
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *sq;
   
   if(p == 0)
     panic("sleep");
@@ -646,19 +1430,22 @@ sleep(void *chan, struct spinlock *lk)
   if(lk == 0)
     panic("sleep without lk");
 
-  // Must acquire ptable.lock in order to
+  // Must acquire our run queue lock in order to
   // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
-  // so it's okay to release lk.
-  if(lk != &ptable.lock){  //DOC: sleeplock0
-    acquire(&ptable.lock);  //DOC: sleeplock1
-    release(lk);
-  }
+  // We are on chan's sleep queue before lk is
+  // released, so a waker holding lk finds us there,
+  // and it then waits for the run queue lock until
+  // we are off the CPU.  So it's okay to release lk.
+  sq = sleepq(chan);
+  acquire(&sq->lock);
+  acquire(&runqueues[p->rq_cpu].lock);  //DOC: sleeplock1
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->sq = sq;
+  list_push(&sq->procs, p);
+  release(&sq->lock);
+  release(lk);
 
   sched();
 
@@ -666,32 +1453,41 @@ sleep(void *chan, struct spinlock *lk)
   p->chan = 0;
 
   // Reacquire original lock.
-  if(lk != &ptable.lock){  //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+  release(&runqueues[p->rq_cpu].lock);  //DOC: sleeplock2
+  acquire(lk);
 }
 
-//PAGEBREAK!
-// Wake up all processes sleeping on chan.
-// The ptable lock must be held.
+// Take p off sleep queue sq and make it runnable.
+// sq->lock must be held.
 static void
-wakeup1(void *chan)
+wakeproc(struct sleepq *sq, struct proc *p)
 {
-  struct proc *p;
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  struct runqueue *rq;
+
+  list_remove(&sq->procs, p);
+  p->sq = 0;
+  rq = lockrq(p);
+  setrunnable(rq, p);
+  release(&rq->lock);
+  kick(p);
 }
 
+//PAGEBREAK!
 // Wake up all processes sleeping on chan.
 void
 wakeup(void *chan)
 {
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+  struct sleepq *sq;
+  struct proc *p, *next;
+
+  sq = sleepq(chan);
+  acquire(&sq->lock);
+  for(p = sq->procs.head; p != 0; p = next){
+    next = p->rq_next;
+    if(p->chan == chan)
+      wakeproc(sq, p);
+  }
+  release(&sq->lock);
 }
 
 // Kill the process with the given pid.
@@ -701,14 +1497,23 @@ int
 kill(int pid)
 {
   struct proc *p;
+  struct sleepq *sq;
 
   acquire(&ptable.lock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->pid == pid){
       p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+      // Wake process from sleep if necessary.  p->sq
+      // can change until its sleep queue is locked.
+      while((sq = p->sq) != 0){
+        acquire(&sq->lock);
+        if(p->sq == sq){
+          wakeproc(sq, p);
+          release(&sq->lock);
+          break;
+        }
+        release(&sq->lock);
+      }
       release(&ptable.lock);
       return 0;
     }
@@ -790,4 +1595,47 @@ get_children_pid(int parent_pid)
     if(p->debugger_parent_pid == parent_pid)
       cprintf("Pid : %d ,child from debugger pid : %d\n",parent_pid ,p->pid);
   }
-}
\ No newline at end of file
+}
+
+// Copy the scheduler statistics of process pid, and the
+// per-CPU counters, into *st.  With pid 0 only the CPU
+// counters are filled in.
+int
+schedstat(int pid, struct schedstat *st)
+{
+  struct proc *p;
+  struct cpu *c;
+  struct cpustat *cs;
+  int i;
+
+  memset(st, 0, sizeof *st);
+  if(pid != 0){
+    acquire(&ptable.lock);
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+      if(p->pid == pid && p->state != UNUSED)
+        break;
+    if(p == &ptable.proc[NPROC]){
+      release(&ptable.lock);
+      return -1;
+    }
+    for(i = 0; i < 3; i++){
+      memmove(st->level[i].wait, p->waithist[i], sizeof st->level[i].wait);
+      memmove(st->level[i].slice, p->slicehist[i], sizeof st->level[i].slice);
+      st->level[i].promotions = p->promotions[i];
+    }
+    release(&ptable.lock);
+  }
+
+  st->ncpu = ncpu;
+  for(i = 0; i < ncpu; i++){
+    c = &cpus[i];
+    cs = &st->cpu[i];
+    cs->switches = c->switches;
+    cs->steals = c->steals;
+    cs->idleticks = c->idleticks;
+    cs->halts = c->halts;
+    cs->wakeups = c->wakeups;
+    cs->wakecycles = c->wakecycles;
+  }
+  return 0;
+}
@@ -8,6 +8,22 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  volatile int idle;           // Halted in scheduler() waiting for work
+  volatile uint kicktsc;       // rdtsc() when a reschedule IPI was sent
+  uint halts;                  // Times the idle loop halted
+  uint wakeups;                // Halts ended by a reschedule IPI
+  uint wakecycles;             // Total IPI-to-wakeup latency in TSC cycles
+  uint switches;               // Context switches into a process
+  uint steals;                 // Processes stolen from other CPUs
+  uint idleticks;              // Timer ticks taken while halted
+  uint64 nexttick;             // rdtsc() when the next tick is due
+  uint64 hrdeadline;           // Sleep deadline the LAPIC timer is set for, or 0
+  int oneshot;                 // LAPIC timer is not periodic
+  uint cr3loads;               // Paging counters, see vmstat.h
+  uint tlbflushes;
+  uint pgfaults;
+  uint lpgfaults;
+  uint lpgsplits;
 };
 
 extern struct cpu cpus[NCPU];
@@ -34,6 +50,27 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+struct sleepq;
+
+// A program segment that exec() left for pagefault() to read
+// in from the process's executable on first touch.
+struct segment {
+  uint vaddr;                  // Page-aligned start address
+  uint off;                    // File offset of vaddr
+  uint filesz;                 // Bytes read from the file; the rest is zero
+  uint memsz;
+};
+
+// A file mapped into the address space by mmap().  Pages are
+// read in by pagefault() when first touched.
+struct vma {
+  uint start;                  // Page-aligned start address
+  uint len;                    // Length in bytes, a multiple of PGSIZE
+  struct file *file;           // Mapped file, or 0 if the slot is free
+  uint off;                    // File offset of start
+  int prot;                    // PROT_READ, PROT_WRITE
+};
+
 // Per-process state
 struct proc {
   uint sz;                     // Size of process memory (bytes)
@@ -49,6 +86,15 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct inode *exe;           // Executable its segments page in from
+  int nseg;
+  struct segment seg[NSEG];
+  int largepages;              // Map untouched 4MB heap regions with PTE_PS
+  int shm[NSHMATT];            // Segment attached in each shm slot, -1 if none
+  struct vma vma[NMMAP];       // File mappings
+  uint pinva[NPIN];            // User buffers of the current system call,
+  uint pinlen[NPIN];           //   which swapout() leaves in memory
+  int npin;
   // added for lab2
   int debugger_parent_pid;     // Parent process pid after set_parent is called
   // added for lab3
@@ -56,7 +102,24 @@ struct proc {
   int arrival_time;
   int executed_cycles;
   int HRRNPriority;
-  int waiting_time;
+  int mhrrn_score;             // Cached MHRRN score, 16.16 fixed point
+  uint enqueue_time;           // ticks when last made runnable or moved to a level
+  int slice_ticks;             // Timer ticks used since last dispatched
+  int rq_level;                // Run queue level this proc is queued in, 0 if none
+  struct proc *rq_next;        // Links for the RR run queue list, or for
+  struct proc *rq_prev;        //   the sleep queue while SLEEPING
+  struct sleepq *sq;           // Sleep queue this proc is on, or null
+  int heap_index;              // Slot in the LCFS heap
+  struct proc *age_next;       // Links for the run queue's aging list
+  struct proc *age_prev;
+  int rq_cpu;                  // CPU whose run queue this proc belongs to
+  uint affinity;               // CPUs it may run on, bit i for CPU i
+  uint64 queuedtsc;            // rdtsc() when it last became RUNNABLE
+  uint waithist[3][NSCHEDHIST];   // Run queue wait per level, see schedstat.h
+  uint slicehist[3][NSCHEDHIST];  // Run slice length per level
+  uint promotions[3];          // Times aging moved it up from each level
+  uint64 deadline;             // rdtsc() to wake at, see timer.c
+  int timer_index;             // Slot in the timer heap, -1 if none
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -64,5 +127,8 @@ struct proc {
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
+//   ...
+//   file mappings, from MMAPBASE up to SHMBASE
+//   shared memory segments, from SHMBASE up to KERNBASE
 
 
@@ -0,0 +1,72 @@
+#include "param.h"
+#include "types.h"
+#include "user.h"
+#include "schedstat.h"
+
+// Usage: schedstat [pid ...]
+// Prints the per-CPU scheduler counters, then the run queue
+// wait and run slice histograms of each given process.
+
+struct schedstat st;
+
+void print_cpus(void)
+{
+    printf(1, "cpu  switches    steals      idleticks   halts       wakeups     avg wakeup cycles\n");
+    for (int i = 0; i < st.ncpu; i++)
+    {
+        struct cpustat *c = &st.cpu[i];
+        printf(1, "%d    %d    %d    %d    %d    %d    %d\n", i, c->switches, c->steals,
+               c->idleticks, c->halts, c->wakeups, c->wakeups ? c->wakecycles / c->wakeups : 0);
+    }
+}
+
+void print_proc(int pid)
+{
+    printf(1, "\npid %d\n", pid);
+    for (int l = 0; l < 3; l++)
+    {
+        struct levelstat *ls = &st.level[l];
+        int any = ls->promotions;
+        for (int b = 0; b < NSCHEDHIST; b++)
+            any += ls->wait[b] + ls->slice[b];
+        if (!any)
+            continue;
+
+        printf(1, "level %d: %d promotions by aging\n", l + 1, ls->promotions);
+        printf(1, "  cycles           wait        slice\n");
+        for (int b = 0; b < NSCHEDHIST; b++)
+        {
+            if (ls->wait[b] == 0 && ls->slice[b] == 0)
+                continue;
+            if (b == 0)
+                printf(1, "  < 2^%d", SCHEDHIST_SHIFT + 1);
+            else if (b == NSCHEDHIST - 1)
+                printf(1, "  >= 2^%d", SCHEDHIST_SHIFT + b);
+            else
+                printf(1, "  2^%d-2^%d", SCHEDHIST_SHIFT + b, SCHEDHIST_SHIFT + b + 1);
+            printf(1, "        %d        %d\n", ls->wait[b], ls->slice[b]);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (schedstat(0, &st) < 0)
+    {
+        printf(2, "schedstat failed\n");
+        exit();
+    }
+    print_cpus();
+
+    for (int i = 1; i < argc; i++)
+    {
+        int pid = atoi(argv[i]);
+        if (schedstat(pid, &st) < 0)
+        {
+            printf(2, "schedstat: no process %d\n", pid);
+            continue;
+        }
+        print_proc(pid);
+    }
+    exit();
+}
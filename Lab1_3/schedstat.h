@@ -0,0 +1,30 @@
+// Scheduler statistics, filled in by the schedstat system call.
+// Latencies are measured in TSC cycles and kept as histograms with
+// power-of-two buckets: bucket 0 counts durations below
+// 2^(SCHEDHIST_SHIFT+1) cycles, bucket i > 0 those in
+// [2^(SCHEDHIST_SHIFT+i), 2^(SCHEDHIST_SHIFT+i+1)), and the last
+// bucket everything longer.
+#define SCHEDHIST_SHIFT 12
+
+// Per-process statistics for one scheduling level.
+struct levelstat {
+  uint wait[NSCHEDHIST];   // Time spent queued before each dispatch
+  uint slice[NSCHEDHIST];  // Length of each run
+  uint promotions;         // Times aging moved the proc up from this level
+};
+
+// Per-CPU counters.
+struct cpustat {
+  uint switches;           // Context switches into a process
+  uint steals;             // Processes stolen from other CPUs
+  uint idleticks;          // Timer ticks taken while halted
+  uint halts;              // Times the idle loop halted
+  uint wakeups;            // Halts ended by a reschedule IPI
+  uint wakecycles;         // Total IPI-to-wakeup latency in TSC cycles
+};
+
+struct schedstat {
+  struct levelstat level[3];   // Indexed by scheduler_queue - 1
+  int ncpu;
+  struct cpustat cpu[NCPU];
+};
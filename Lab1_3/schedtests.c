@@ -0,0 +1,481 @@
+// Tests of the scheduler: run queues, aging, priorities,
+// time slices, timed sleeps and CPU affinity.  Like usertests,
+// each test prints OK or exits early with a message saying
+// what went wrong.  Results that only a child can see come
+// back to the parent as one byte on a pipe.
+
+#include "param.h"
+#include "types.h"
+#include "user.h"
+#include "schedstat.h"
+
+int stdout = 1;
+struct schedstat st;
+
+// Busy-wait for n ticks.
+void
+spin(int n)
+{
+  int t0;
+
+  t0 = uptime();
+  while(uptime() - t0 < n)
+    ;
+}
+
+// Runs counted in histogram h.
+uint
+histsum(uint *h)
+{
+  uint n;
+  int i;
+
+  n = 0;
+  for(i = 0; i < NSCHEDHIST; i++)
+    n += h[i];
+  return n;
+}
+
+// Read the byte a child sent on fd; 0 if it sent none.
+char
+result(int fd)
+{
+  char c;
+
+  if(read(fd, &c, 1) != 1)
+    return 0;
+  return c;
+}
+
+// does a process moved to each level get run from that
+// level's queue?
+void
+queuetest(void)
+{
+  int fds[2], q;
+  char ok;
+
+  printf(stdout, "queue test\n");
+  if(set_schedule_queue(getpid(), 0) != -1 ||
+     set_schedule_queue(getpid(), 4) != -1){
+    printf(stdout, "queue test: bad level accepted\n");
+    exit();
+  }
+  if(pipe(fds) != 0){
+    printf(stdout, "queue test pipe failed\n");
+    exit();
+  }
+  for(q = 1; q <= 3; q++){
+    if(fork() == 0){
+      set_schedule_queue(getpid(), q);
+      // give up the CPU, so the next run comes from level q
+      sleep(1);
+      spin(3);
+      ok = schedstat(getpid(), &st) == 0 &&
+           histsum(st.level[q-1].slice) > 0;
+      write(fds[1], &ok, 1);
+      exit();
+    }
+    ok = result(fds[0]);
+    wait();
+    if(!ok){
+      printf(stdout, "queue test: level %d never ran its process\n", q);
+      exit();
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  printf(stdout, "queue test OK\n");
+}
+
+// with a spinner for every CPU, does every CPU run processes,
+// each from its own run queue?
+void
+percputest(void)
+{
+  uint before[NCPU];
+  int i, n;
+
+  printf(stdout, "per-cpu run queue test\n");
+  schedstat(0, &st);
+  n = st.ncpu;
+  for(i = 0; i < n; i++)
+    before[i] = st.cpu[i].switches;
+  for(i = 0; i < n; i++){
+    if(fork() == 0){
+      spin(10);
+      exit();
+    }
+  }
+  for(i = 0; i < n; i++)
+    wait();
+  schedstat(0, &st);
+  for(i = 0; i < n; i++){
+    if(st.cpu[i].switches == before[i]){
+      printf(stdout, "per-cpu run queue test: cpu %d ran nothing\n", i);
+      exit();
+    }
+  }
+  printf(stdout, "per-cpu run queue test OK\n");
+}
+
+// does a process starved by a busy higher level get moved up
+// by aging, after about AGINGTICKS ticks?  Takes that long.
+void
+agingtest(void)
+{
+  int fds[2], spinner, t0, elapsed;
+  char ok;
+
+  printf(stdout, "aging test\n");
+  if(pipe(fds) != 0){
+    printf(stdout, "aging test pipe failed\n");
+    exit();
+  }
+  // keep CPU 0's level 2 busy
+  spinner = fork();
+  if(spinner == 0){
+    set_affinity(getpid(), 1);
+    set_schedule_queue(getpid(), 2);
+    for(;;)
+      ;
+  }
+  sleep(5);
+  t0 = uptime();
+  if(fork() == 0){
+    set_affinity(getpid(), 1);
+    set_schedule_queue(getpid(), 3);
+    // queue on CPU 0's level 3, behind the spinner
+    sleep(1);
+    ok = schedstat(getpid(), &st) == 0 && st.level[2].promotions > 0;
+    write(fds[1], &ok, 1);
+    exit();
+  }
+  ok = result(fds[0]);
+  elapsed = uptime() - t0;
+  kill(spinner);
+  wait();
+  wait();
+  if(!ok){
+    printf(stdout, "aging test: ran without being promoted\n");
+    exit();
+  }
+  if(elapsed > AGINGTICKS + 100){
+    printf(stdout, "aging test: starved for %d ticks\n", elapsed);
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  printf(stdout, "aging test OK\n");
+}
+
+// Busy loop iterations that take about one tick of CPU.
+uint
+loopspertick(void)
+{
+  volatile uint n;
+  int t0;
+
+  t0 = uptime();
+  while(uptime() == t0)
+    ;
+  t0 = uptime();
+  for(n = 0; uptime() - t0 < 5; n++)
+    ;
+  return n / 5;
+}
+
+// of two level 3 processes competing for one CPU, does the
+// one with the higher HRRN priority finish its work first?
+void
+mhrrntest(void)
+{
+  int go[2], done[2], i;
+  uint work;
+  volatile uint n;
+  char tag, first;
+
+  printf(stdout, "mhrrn test\n");
+  if(pipe(go) != 0 || pipe(done) != 0){
+    printf(stdout, "mhrrn test pipe failed\n");
+    exit();
+  }
+  work = 20 * loopspertick();
+  for(i = 0; i < 2; i++){
+    if(fork() == 0){
+      tag = i == 0 ? 'l' : 'h';
+      set_affinity(getpid(), 1);
+      set_schedule_queue(getpid(), 3);
+      set_HRRN_priority_proc(getpid(), i == 0 ? 0 : 1000);
+      if(read(go[0], &first, 1) != 1)
+        exit();
+      for(n = 0; n < work; n++)
+        ;
+      write(done[1], &tag, 1);
+      exit();
+    }
+  }
+  sleep(2);
+  write(go[1], "gg", 2);
+  first = result(done[0]);
+  result(done[0]);
+  wait();
+  wait();
+  if(first != 'h'){
+    printf(stdout, "mhrrn test: low priority finished first\n");
+    exit();
+  }
+  close(go[0]);
+  close(go[1]);
+  close(done[0]);
+  close(done[1]);
+  printf(stdout, "mhrrn test OK\n");
+}
+
+// while every process sleeps, do the CPUs halt, rather than
+// spin, and count the ticks they spend halted?
+void
+idletest(void)
+{
+  uint halts, idleticks;
+  int i;
+
+  printf(stdout, "idle test\n");
+  schedstat(0, &st);
+  halts = idleticks = 0;
+  for(i = 0; i < st.ncpu; i++){
+    halts += st.cpu[i].halts;
+    idleticks += st.cpu[i].idleticks;
+  }
+  sleep(20);
+  schedstat(0, &st);
+  for(i = 0; i < st.ncpu; i++){
+    halts -= st.cpu[i].halts;
+    idleticks -= st.cpu[i].idleticks;
+  }
+  if(halts == 0 || idleticks == 0){
+    printf(stdout, "idle test: no cpu halted\n");
+    exit();
+  }
+  printf(stdout, "idle test OK\n");
+}
+
+// does schedstat report a process's waits and run slices at
+// its level, and refuse a pid that doesn't exist?
+void
+schedstattest(void)
+{
+  printf(stdout, "schedstat test\n");
+  if(schedstat(-1, &st) != -1){
+    printf(stdout, "schedstat test: bad pid accepted\n");
+    exit();
+  }
+  spin(3);
+  if(schedstat(getpid(), &st) != 0 || st.ncpu < 1 || st.ncpu > NCPU){
+    printf(stdout, "schedstat test schedstat failed\n");
+    exit();
+  }
+  if(histsum(st.level[1].wait) == 0 || histsum(st.level[1].slice) == 0){
+    printf(stdout, "schedstat test: no level 2 runs counted\n");
+    exit();
+  }
+  printf(stdout, "schedstat test OK\n");
+}
+
+// Longest run slice of a child spinning at level 1 with a
+// time slice of nticks, as a histogram bucket.
+int
+longestslice(int nticks)
+{
+  int fds[2], b;
+  char top;
+
+  if(pipe(fds) != 0){
+    printf(stdout, "quantum test pipe failed\n");
+    exit();
+  }
+  set_queue_quantum(1, nticks);
+  if(fork() == 0){
+    set_schedule_queue(getpid(), 1);
+    sleep(1);
+    spin(4 * nticks + 4);
+    schedstat(getpid(), &st);
+    top = 0;
+    for(b = 0; b < NSCHEDHIST; b++)
+      if(st.level[0].slice[b])
+        top = b;
+    write(fds[1], &top, 1);
+    exit();
+  }
+  top = result(fds[0]);
+  wait();
+  set_queue_quantum(1, 1);
+  close(fds[0]);
+  close(fds[1]);
+  return top;
+}
+
+// are bad time slices refused, and does a longer time slice
+// let a process run longer before it is switched out?
+void
+quantumtest(void)
+{
+  printf(stdout, "quantum test\n");
+  if(set_queue_quantum(0, 1) != -1 || set_queue_quantum(4, 1) != -1 ||
+     set_queue_quantum(1, 0) != -1 || set_queue_quantum(1, MAXQUANTUM+1) != -1){
+    printf(stdout, "quantum test: bad quantum accepted\n");
+    exit();
+  }
+  // 8 ticks is three histogram buckets above 1 tick
+  if(longestslice(8) < longestslice(1) + 2){
+    printf(stdout, "quantum test: longer quantum, same slices\n");
+    exit();
+  }
+  printf(stdout, "quantum test OK\n");
+}
+
+// do sleepers on many different channels each wake when their
+// own channel is woken, and in order, and do many sleepers on
+// one channel all wake?
+void
+wakeuptest(void)
+{
+  int fds[2], i;
+  char c;
+
+  printf(stdout, "wakeup test\n");
+  if(pipe(fds) != 0){
+    printf(stdout, "wakeup test pipe failed\n");
+    exit();
+  }
+  // each timed sleeper waits on a channel of its own
+  for(i = 0; i < 16; i++){
+    if(fork() == 0){
+      sleep(2 * (16 - i));
+      c = i;
+      write(fds[1], &c, 1);
+      exit();
+    }
+  }
+  for(i = 15; i >= 0; i--){
+    if(result(fds[0]) != i){
+      printf(stdout, "wakeup test: timed sleepers woke out of order\n");
+      exit();
+    }
+  }
+  for(i = 0; i < 16; i++)
+    wait();
+
+  // all readers of one pipe sleep on the same channel
+  for(i = 0; i < 8; i++){
+    if(fork() == 0){
+      read(fds[0], &c, 1);
+      exit();
+    }
+  }
+  sleep(2);
+  write(fds[1], "xxxxxxxx", 8);
+  for(i = 0; i < 8; i++)
+    wait();
+  close(fds[0]);
+  close(fds[1]);
+  printf(stdout, "wakeup test OK\n");
+}
+
+// are bad nanosleep() times refused, and do sleeps shorter
+// than a tick end before the next tick?
+void
+nanosleeptest(void)
+{
+  int i, t0;
+
+  printf(stdout, "nanosleep test\n");
+  if(nanosleep(-1, 0) != -1 || nanosleep(0, -1) != -1 ||
+     nanosleep(0, 1000000000) != -1){
+    printf(stdout, "nanosleep test: bad time accepted\n");
+    exit();
+  }
+  // twenty 1ms sleeps take two ticks, not twenty
+  t0 = uptime();
+  for(i = 0; i < 20; i++){
+    if(nanosleep(0, 1000000) != 0){
+      printf(stdout, "nanosleep test nanosleep failed\n");
+      exit();
+    }
+  }
+  if(uptime() - t0 >= 10){
+    printf(stdout, "nanosleep test: 1ms sleeps took %d ticks\n", uptime() - t0);
+    exit();
+  }
+  t0 = uptime();
+  sleep(5);
+  if(uptime() - t0 < 4){
+    printf(stdout, "nanosleep test: sleep(5) ended early\n");
+    exit();
+  }
+  printf(stdout, "nanosleep test OK\n");
+}
+
+// are affinity masks set, checked, and inherited by fork()?
+void
+affinitytest(void)
+{
+  int fds[2], all;
+  char ok;
+
+  printf(stdout, "affinity test\n");
+  schedstat(0, &st);
+  all = (1 << st.ncpu) - 1;
+  if(get_affinity(getpid()) != all){
+    printf(stdout, "affinity test: not allowed on every cpu\n");
+    exit();
+  }
+  if(set_affinity(getpid(), 0) != -1 || set_affinity(-1, 1) != -1 ||
+     get_affinity(-1) != -1){
+    printf(stdout, "affinity test: bad mask or pid accepted\n");
+    exit();
+  }
+  if(set_affinity(getpid(), 1) != 0 || get_affinity(getpid()) != 1){
+    printf(stdout, "affinity test set_affinity failed\n");
+    exit();
+  }
+  if(pipe(fds) != 0){
+    printf(stdout, "affinity test pipe failed\n");
+    exit();
+  }
+  if(fork() == 0){
+    ok = get_affinity(getpid()) == 1;
+    write(fds[1], &ok, 1);
+    exit();
+  }
+  ok = result(fds[0]);
+  wait();
+  set_affinity(getpid(), all);
+  if(!ok){
+    printf(stdout, "affinity test: child did not inherit the mask\n");
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  printf(stdout, "affinity test OK\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  printf(stdout, "schedtests starting\n");
+
+  queuetest();
+  percputest();
+  mhrrntest();
+  idletest();
+  schedstattest();
+  quantumtest();
+  wakeuptest();
+  nanosleeptest();
+  affinitytest();
+  agingtest();
+
+  printf(stdout, "ALL SCHED TESTS PASSED\n");
+  exit();
+}
@@ -0,0 +1,253 @@
+// Shared memory segments.
+//
+// shm_open() finds or creates the segment with a given key,
+// a set of zeroed pages.  shm_attach() maps a segment's pages
+// into a free slot of the process's shm region, below KERNBASE,
+// so processes attached to it read and write the same memory.
+// Every mapping holds a page reference, so deallocuvm() and
+// freevm() drop them like any other page.  fork() copies a
+// parent's attachments, and exec() and exit() detach them all.
+//
+// A segment lives until shm_unlink() removes its key and its
+// last attachment goes away, so it survives between shm_open()
+// and shm_attach() even if nothing is attached.  Segment ids
+// carry a generation number, so an id of a segment that has
+// been freed does not attach a later segment in the same slot.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "meminfo.h"
+
+#define SHMVA(slot) (SHMBASE + (slot)*SHMMAXPG*PGSIZE)
+#define SHMGEN      0xFFFFF     // Generations an id tells apart
+
+struct shmseg {
+  int key;
+  int ref;                      // Attachments
+  int unlinked;                 // shm_unlink() removed the key
+  uint gen;                     // Times the slot has been used
+  uint npages;                  // 0 if the slot is free
+  char *pages[SHMMAXPG];
+};
+
+struct {
+  struct spinlock lock;
+  struct shmseg seg[NSHM];
+} shmtable;
+
+void
+shminit(void)
+{
+  initlock(&shmtable.lock, "shmtable");
+}
+
+static int
+shmid(struct shmseg *s)
+{
+  return (s->gen & SHMGEN) * NSHM + (s - shmtable.seg);
+}
+
+// The live segment with id, or 0.  Caller holds shmtable.lock.
+static struct shmseg*
+shmlookup(int id)
+{
+  struct shmseg *s;
+
+  if(id < 0)
+    return 0;
+  s = &shmtable.seg[id % NSHM];
+  if(s->npages == 0 || (s->gen & SHMGEN) != id / NSHM)
+    return 0;
+  return s;
+}
+
+// Free s's pages.  Caller holds shmtable.lock.
+static void
+shmfree(struct shmseg *s)
+{
+  uint i;
+
+  for(i = 0; i < s->npages; i++)
+    kfree(s->pages[i]);
+  s->npages = 0;
+}
+
+// Return the id of the segment with key, creating it with
+// size bytes if there is none.  Returns -1 on error.
+int
+shmopen(int key, uint size)
+{
+  struct shmseg *s, *empty;
+  uint i;
+
+  acquire(&shmtable.lock);
+  empty = 0;
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++){
+    if(s->npages && !s->unlinked && s->key == key){
+      i = shmid(s);
+      release(&shmtable.lock);
+      if(size > s->npages*PGSIZE)
+        return -1;
+      return i;
+    }
+    if(empty == 0 && s->npages == 0)
+      empty = s;
+  }
+  if(empty == 0 || size == 0 || size > SHMMAXPG*PGSIZE){
+    release(&shmtable.lock);
+    return -1;
+  }
+  s = empty;
+  for(i = 0; i < PGROUNDUP(size)/PGSIZE; i++){
+    if((s->pages[i] = kzalloc()) == 0){
+      while(i-- > 0)
+        kfree(s->pages[i]);
+      release(&shmtable.lock);
+      return -1;
+    }
+    kcharge(s->pages[i], MEM_SHM);
+  }
+  s->key = key;
+  s->ref = 0;
+  s->unlinked = 0;
+  s->gen++;
+  s->npages = i;
+  i = shmid(s);
+  release(&shmtable.lock);
+  return i;
+}
+
+// Remove key, so shm_open() no longer finds its segment.
+// The segment is freed once nothing is attached to it.
+int
+shmunlink(int key)
+{
+  struct shmseg *s;
+
+  acquire(&shmtable.lock);
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++){
+    if(s->npages && !s->unlinked && s->key == key){
+      s->unlinked = 1;
+      if(s->ref == 0)
+        shmfree(s);
+      release(&shmtable.lock);
+      return 0;
+    }
+  }
+  release(&shmtable.lock);
+  return -1;
+}
+
+// Drop an attachment of s, freeing s with the last one
+// if its key has been unlinked.
+static void
+shmput(struct shmseg *s)
+{
+  acquire(&shmtable.lock);
+  if(--s->ref == 0 && s->unlinked)
+    shmfree(s);
+  release(&shmtable.lock);
+}
+
+// Map segment id into slot of p.
+static int
+shmmap(struct proc *p, int slot, int id)
+{
+  struct shmseg *s;
+
+  acquire(&shmtable.lock);
+  if((s = shmlookup(id)) == 0){
+    release(&shmtable.lock);
+    return -1;
+  }
+  s->ref++;
+  release(&shmtable.lock);
+
+  // Our reference keeps s->pages from changing.
+  if(mapshared(p->pgdir, SHMVA(slot), s->pages, s->npages, PTE_W|PTE_U) < 0){
+    shmput(s);
+    return -1;
+  }
+  p->shm[slot] = id;
+  return 0;
+}
+
+// Attach segment id to the current process.
+// Returns the address it is mapped at, or -1.
+int
+shmattach(int id)
+{
+  struct proc *curproc = myproc();
+  int slot;
+
+  for(slot = 0; slot < NSHMATT; slot++)
+    if(curproc->shm[slot] < 0)
+      break;
+  if(slot == NSHMATT || shmmap(curproc, slot, id) < 0)
+    return -1;
+  return SHMVA(slot);
+}
+
+static void
+shmunmap(struct proc *p, int slot)
+{
+  struct shmseg *s = &shmtable.seg[p->shm[slot] % NSHM];
+
+  deallocuvm(p->pgdir, SHMVA(slot) + s->npages*PGSIZE, SHMVA(slot));
+  p->shm[slot] = -1;
+  shmput(s);
+}
+
+// Detach the segment attached at va from the current process.
+int
+shmdetach(uint va)
+{
+  struct proc *curproc = myproc();
+  int slot;
+
+  if(va < SHMBASE || va >= SHMVA(NSHMATT) || (va - SHMBASE) % (SHMMAXPG*PGSIZE))
+    return -1;
+  slot = (va - SHMBASE) / (SHMMAXPG*PGSIZE);
+  if(curproc->shm[slot] < 0)
+    return -1;
+  shmunmap(curproc, slot);
+  flushtlb(curproc->pgdir);
+  return 0;
+}
+
+// Give child np the parent's attachments, at the same addresses.
+int
+shmfork(struct proc *np, struct proc *parent)
+{
+  int slot;
+
+  for(slot = 0; slot < NSHMATT; slot++){
+    if(parent->shm[slot] >= 0 && shmmap(np, slot, parent->shm[slot]) < 0){
+      shmdetachall(np);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Detach all of p's segments, from exec() or exit().
+void
+shmdetachall(struct proc *p)
+{
+  int slot, n;
+
+  n = 0;
+  for(slot = 0; slot < NSHMATT; slot++){
+    if(p->shm[slot] >= 0){
+      shmunmap(p, slot);
+      n++;
+    }
+  }
+  if(n && p == myproc())
+    flushtlb(p->pgdir);
+}
@@ -0,0 +1,72 @@
+#include "types.h"
+#include "user.h"
+
+// Producer/consumer over a shared memory ring: the parent
+// writes n integers into it and a forked child reads them
+// back, without either going through the kernel per item.
+
+#define KEY 0x53484d
+#define NSLOT 1000
+
+struct ring {
+    volatile uint head;         // Items the producer has put
+    volatile uint tail;         // Items the consumer has taken
+    volatile int data[NSLOT];
+};
+
+int main(int argc, char* argv[])
+{
+    struct ring *r;
+    uint i, n, sum, expect;
+    int id;
+
+    n = argc > 1 ? atoi(argv[1]) : 100000;
+    id = shm_open(KEY, sizeof(struct ring));
+    if (id < 0)
+    {
+        printf(1, "shm_open failed\n");
+        exit();
+    }
+    r = (struct ring*)shm_attach(id);
+    if (r == (struct ring*)-1)
+    {
+        printf(1, "shm_attach failed\n");
+        shm_unlink(KEY);
+        exit();
+    }
+    r->head = r->tail = 0;
+
+    expect = 0;
+    for (i = 0; i < n; i++)
+        expect += i;
+
+    if (fork() == 0)
+    {
+        sum = 0;
+        for (i = 0; i < n; i++)
+        {
+            while (r->tail == r->head)
+                sleep(1);
+            sum += r->data[r->tail % NSLOT];
+            r->tail++;
+        }
+        if (sum == expect)
+            printf(1, "consumer: got %d items, sum ok\n", n);
+        else
+            printf(1, "consumer: sum %d, expected %d\n", sum, expect);
+        shm_detach(r);
+        exit();
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        while (r->head - r->tail == NSLOT)
+            sleep(1);
+        r->data[r->head % NSLOT] = i;
+        r->head++;
+    }
+    wait();
+    shm_detach(r);
+    shm_unlink(KEY);
+    exit();
+}
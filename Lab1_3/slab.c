@@ -0,0 +1,260 @@
+// Slab allocator for fixed-size kernel objects.
+//
+// A slabcache hands out objects of one size, carved from
+// slabs: single kalloc() pages with a struct slab header at
+// the start, so the slab of an object is PGROUNDDOWN of its
+// address.  Slabs with free objects sit on the cache's partial
+// list; full slabs sit on no list and rejoin it when an object
+// comes back.  A slab whose objects are all free goes back to
+// kalloc(), unless it is the cache's last partial slab.
+//
+// Each CPU keeps a magazine, a small stack of free objects
+// that it uses with interrupts off and no lock.  An empty
+// magazine takes half a magazine's worth from the slabs under
+// the cache's lock, and a full one gives half back.  Caches
+// that must return memory on demand, such as the buffer cache,
+// skip the magazines with slabget() and slabput().
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "slab.h"
+#include "meminfo.h"
+
+struct slab {
+  struct slab *next;           // On the cache's partial list
+  struct slab *prev;
+  void *freelist;              // Free objects in this slab
+  uint inuse;                  // Objects not on freelist
+};
+
+#define SLABHDR ((sizeof(struct slab) + 7) & ~7)
+
+// Caches to report to meminfo.
+static struct {
+  struct spinlock lock;
+  int n;
+  struct slabcache *cache[NSLABINFO];
+} slabcaches;
+
+void
+slabinit(struct slabcache *c, char *name, uint size)
+{
+  size = (size + 7) & ~7;
+  if(size > PGSIZE - SLABHDR)
+    panic("slabinit: object too big");
+  memset(c, 0, sizeof(*c));
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - SLABHDR) / size;
+
+  if(slabcaches.n == 0)   // first cache, still booting on one CPU
+    initlock(&slabcaches.lock, "slabcaches");
+  acquire(&slabcaches.lock);
+  if(slabcaches.n < NSLABINFO)
+    slabcaches.cache[slabcaches.n++] = c;
+  release(&slabcaches.lock);
+}
+
+static void
+partial_push(struct slabcache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+static void
+partial_unlink(struct slabcache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Add a fresh slab to the partial list.
+// Caller holds c->lock.
+static struct slab*
+newslab(struct slabcache *c)
+{
+  struct slab *s;
+  char *obj;
+  uint i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  kcharge((char*)s, MEM_SLAB);
+  s->freelist = 0;
+  s->inuse = 0;
+  obj = (char*)s + SLABHDR + (c->perslab - 1) * c->size;
+  for(i = 0; i < c->perslab; i++, obj -= c->size){
+    *(void**)obj = s->freelist;
+    s->freelist = obj;
+  }
+  c->nslabs++;
+  partial_push(c, s);
+  return s;
+}
+
+// Take a free object from the slabs, adding a slab if
+// there is none.  Caller holds c->lock.
+static void*
+slabtake(struct slabcache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  if((s = c->partial) == 0 && (s = newslab(c)) == 0)
+    return 0;
+  obj = s->freelist;
+  s->freelist = *(void**)obj;
+  s->inuse++;
+  if(s->freelist == 0)
+    partial_unlink(c, s);
+  c->nobjs++;
+  return obj;
+}
+
+// Put obj back on its slab.  Returns 1 if that emptied the
+// slab and its page went back to kalloc().
+// Caller holds c->lock.
+static int
+slabgive(struct slabcache *c, void *obj)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)obj);
+  if(s->freelist == 0)
+    partial_push(c, s);
+  *(void**)obj = s->freelist;
+  s->freelist = obj;
+  s->inuse--;
+  c->nobjs--;
+  if(s->inuse == 0 && (s->prev || s->next)){
+    partial_unlink(c, s);
+    c->nslabs--;
+    kfree((char*)s);
+    return 1;
+  }
+  return 0;
+}
+
+// Move objects from the slabs into magazine m until it is
+// half full or memory runs out.
+static void
+magfill(struct slabcache *c, struct magazine *m)
+{
+  void *obj;
+
+  acquire(&c->lock);
+  while(m->n < MAGSIZE/2 && (obj = slabtake(c)) != 0)
+    m->obj[m->n++] = obj;
+  release(&c->lock);
+}
+
+// Return half of magazine m to the slabs.
+static void
+magdrain(struct slabcache *c, struct magazine *m)
+{
+  acquire(&c->lock);
+  while(m->n > MAGSIZE/2)
+    slabgive(c, m->obj[--m->n]);
+  release(&c->lock);
+}
+
+// Allocate a zeroed object from cache c.
+// Returns 0 if the memory cannot be allocated.
+void*
+slaballoc(struct slabcache *c)
+{
+  struct magazine *m;
+  void *obj;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  if(m->n == 0)
+    magfill(c, m);
+  obj = m->n > 0 ? m->obj[--m->n] : 0;
+  popcli();
+  if(obj)
+    memset(obj, 0, c->size);
+  return obj;
+}
+
+// Free an object allocated from cache c.
+void
+slabfree(struct slabcache *c, void *obj)
+{
+  struct magazine *m;
+
+  if((uint)obj % 8 || ((uint)obj % PGSIZE) < SLABHDR)
+    panic("slabfree");
+  pushcli();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE)
+    magdrain(c, m);
+  m->obj[m->n++] = obj;
+  popcli();
+}
+
+// Like slaballoc(), but straight from the slabs, skipping the
+// magazines.  For caches that give memory back with slabput().
+void*
+slabget(struct slabcache *c)
+{
+  void *obj;
+
+  acquire(&c->lock);
+  obj = slabtake(c);
+  release(&c->lock);
+  if(obj)
+    memset(obj, 0, c->size);
+  return obj;
+}
+
+// Free an object allocated with slabget().  It goes straight
+// back to its slab rather than sitting in a magazine, so that
+// freeing objects frees pages.  Returns 1 if a page was freed.
+int
+slabput(struct slabcache *c, void *obj)
+{
+  int r;
+
+  if((uint)obj % 8 || ((uint)obj % PGSIZE) < SLABHDR)
+    panic("slabput");
+  acquire(&c->lock);
+  r = slabgive(c, obj);
+  release(&c->lock);
+  return r;
+}
+
+// Fill in the slab caches of *mi for the meminfo system call.
+void
+slabstat(struct meminfo *mi)
+{
+  struct slabinfo *si;
+  struct slabcache *c;
+  int i;
+
+  acquire(&slabcaches.lock);
+  for(i = 0; i < slabcaches.n; i++){
+    c = slabcaches.cache[i];
+    si = &mi->slab[i];
+    acquire(&c->lock);
+    safestrcpy(si->name, c->name, sizeof(si->name));
+    si->size = c->size;
+    si->nslabs = c->nslabs;
+    si->nobjs = c->nobjs;
+    release(&c->lock);
+  }
+  mi->nslab = slabcaches.n;
+  release(&slabcaches.lock);
+}
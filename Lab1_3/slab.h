@@ -0,0 +1,19 @@
+// Cache of fixed-size kernel objects; see slab.c.
+
+#define MAGSIZE 16              // Objects in a per-CPU magazine
+
+struct magazine {
+  int n;                        // Objects in obj[]
+  void *obj[MAGSIZE];
+};
+
+struct slabcache {
+  struct spinlock lock;         // Protects partial and the counters
+  char *name;
+  uint size;                    // Object size, rounded up
+  uint perslab;                 // Objects per slab page
+  struct slab *partial;         // Slabs with at least one free object
+  uint nslabs;                  // Slab pages allocated
+  uint nobjs;                   // Objects handed out, including magazines
+  struct magazine mag[NCPU];    // Per-CPU stacks of free objects
+};
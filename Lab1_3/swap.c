@@ -0,0 +1,206 @@
+// Swap space for user pages.
+//
+// mkfs leaves SWAPBLOCKS blocks after the file system for swap,
+// and the superblock says where.  Each slot holds one page.
+// When there is no free page for user memory, or free memory
+// runs low, swapout() moves a clock hand over the pages of
+// processes that are not running (see swapvictim() and
+// clockscan()) and writes the pages it picks to swap.  Their
+// PTEs then hold the slot, with PTE_SWAP set and PTE_P clear,
+// and pagefault() reads the page back on the next touch.
+// After fork() a slot can be shared by the PTEs of several
+// processes; it is free once none refers to it and it is not
+// being written.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "vmstat.h"
+#include "meminfo.h"
+
+#define BPP        (PGSIZE/BSIZE)   // Blocks per page
+#define NSWAPPG    (SWAPBLOCKS/BPP)
+#define SWAPLOW    64               // Swap out when fewer pages are free
+#define SWAPBATCH  8                // Pages swapped out at a time
+
+struct {
+  struct spinlock lock;
+  uint dev;
+  uint start;                   // First swap block
+  int nslot;                    // 0 if the disk has no swap area
+  ushort ref[NSWAPPG];          // PTEs that refer to each slot
+  uchar busy[NSWAPPG];          // Slot is being written
+  int nused;                    // Slots with ref or busy set
+  uint swapins;
+  uint swapouts;
+} swap;
+
+// Buffer for swap I/O, which never goes through the buffer
+// cache.  Its lock serializes swap I/O.
+static struct buf swapbuf;
+
+void
+swapinit(int dev)
+{
+  struct superblock sb;
+
+  initlock(&swap.lock, "swap");
+  initsleeplock(&swapbuf.lock, "swapbuf");
+  readsb(dev, &sb);
+  swap.dev = dev;
+  swap.start = sb.swapstart;
+  swap.nslot = sb.nswap / BPP;
+  if(swap.nslot > NSWAPPG)
+    swap.nslot = NSWAPPG;
+}
+
+// Reserve a free slot, busy until swapout() has written it.
+// Returns -1 if swap is full.
+int
+swapalloc(void)
+{
+  int i;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    if(swap.ref[i] == 0 && !swap.busy[i]){
+      swap.ref[i] = 1;
+      swap.busy[i] = 1;
+      swap.nused++;
+      release(&swap.lock);
+      return i;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Another PTE refers to slot.
+void
+swapdup(int slot)
+{
+  acquire(&swap.lock);
+  swap.ref[slot]++;
+  release(&swap.lock);
+}
+
+// A PTE no longer refers to slot.
+void
+swapfree(int slot)
+{
+  acquire(&swap.lock);
+  if(swap.ref[slot] < 1)
+    panic("swapfree");
+  if(--swap.ref[slot] == 0 && !swap.busy[slot])
+    swap.nused--;
+  release(&swap.lock);
+}
+
+static void
+swapio(int slot, char *mem, int write)
+{
+  int i;
+
+  acquiresleep(&swapbuf.lock);
+  for(i = 0; i < BPP; i++){
+    swapbuf.dev = swap.dev;
+    swapbuf.blockno = swap.start + slot*BPP + i;
+    if(write){
+      memmove(swapbuf.data, mem + i*BSIZE, BSIZE);
+      swapbuf.flags = B_DIRTY;
+    } else
+      swapbuf.flags = 0;
+    iderw(&swapbuf);
+    if(!write)
+      memmove(mem + i*BSIZE, swapbuf.data, BSIZE);
+  }
+  releasesleep(&swapbuf.lock);
+}
+
+// Read the page in slot into mem, once any write to it is done.
+void
+swapread(int slot, char *mem)
+{
+  acquire(&swap.lock);
+  while(swap.busy[slot])
+    sleep(&swap.busy[slot], &swap.lock);
+  release(&swap.lock);
+
+  // The caller's reference keeps slot from being reused.
+  swapio(slot, mem, 0);
+
+  acquire(&swap.lock);
+  swap.swapins++;
+  release(&swap.lock);
+}
+
+// Swap out up to n pages.  Returns how many were freed.
+int
+swapout(int n)
+{
+  char *mem;
+  int done, slot;
+
+  for(done = 0; done < n && swap.nused < swap.nslot; done++){
+    if((mem = swapvictim(&slot)) == 0)
+      break;
+    swapio(slot, mem, 1);
+    acquire(&swap.lock);
+    swap.busy[slot] = 0;
+    if(swap.ref[slot] == 0)
+      swap.nused--;
+    swap.swapouts++;
+    wakeup(&swap.busy[slot]);
+    release(&swap.lock);
+    kfree(mem);
+  }
+  return done;
+}
+
+// Give up to SWAPBATCH pages of the kernel's disk caches back
+// to kalloc().  Returns how many pages were freed.
+static int
+shrinkcaches(void)
+{
+  int n;
+
+  n = bshrink(SWAPBATCH);
+  if(n < SWAPBATCH)
+    n += ishrink(SWAPBATCH - n);
+  return n;
+}
+
+// Allocate a page for user memory, shrinking the buffer and
+// inode caches or swapping other processes' pages out to make
+// room when memory runs low.  The page is zeroed if zero is set; callers
+// that fill the whole page themselves skip that.
+// Returns 0 if memory and swap are both full.
+char*
+allocuser(int zero)
+{
+  char *mem;
+
+  if(kfreepages() < SWAPLOW && shrinkcaches() == 0 && swap.nslot)
+    swapout(SWAPBATCH);
+  while((mem = zero ? kzalloc() : kalloc()) == 0)
+    if(shrinkcaches() == 0 && swapout(SWAPBATCH) == 0)
+      return 0;
+  kcharge(mem, MEM_USER);
+  return mem;
+}
+
+void
+swapstat(struct vmstat *st)
+{
+  acquire(&swap.lock);
+  st->swapslots = swap.nslot;
+  st->swapused = swap.nused;
+  st->swapins = swap.swapins;
+  st->swapouts = swap.swapouts;
+  release(&swap.lock);
+}
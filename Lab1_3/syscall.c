@@ -21,7 +21,19 @@ fetchint(uint addr, int *ip)
 
   if(addr >= curproc->sz || addr+4 > curproc->sz)
     return -1;
+  // Pin the word while it is read, so that swapout() can't
+  // take it back if we are preempted after bringing it in.
+  if(curproc->npin == NPIN)
+    return -1;
+  curproc->pinva[curproc->npin] = addr;
+  curproc->pinlen[curproc->npin] = 4;
+  curproc->npin++;
+  if(pagein(curproc, addr, 4, 0) < 0){
+    curproc->npin--;
+    return -1;
+  }
   *ip = *(int*)(addr);
+  curproc->npin--;
   return 0;
 }
 
@@ -32,15 +44,32 @@ int
 fetchstr(uint addr, char **pp)
 {
   char *s, *ep;
+  int pin;
   struct proc *curproc = myproc();
 
   if(addr >= curproc->sz)
     return -1;
+  // The kernel uses the string for the rest of the system
+  // call, so pin it, a page at a time as it is found.
+  if(curproc->npin == NPIN)
+    return -1;
+  pin = curproc->npin;
+  curproc->pinva[pin] = addr;
+  curproc->pinlen[pin] = 0;
+  curproc->npin++;
   *pp = (char*)addr;
   ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
-    if(*s == 0)
+    // Bring each page in before looking at it.
+    if(s == *pp || (uint)s % PGSIZE == 0){
+      curproc->pinlen[pin] = PGROUNDUP((uint)s + 1) - addr;
+      if(pagein(curproc, (uint)s, 1, 0) < 0)
+        return -1;
+    }
+    if(*s == 0){
+      curproc->pinlen[pin] = s + 1 - *pp;
       return s - *pp;
+    }
   }
   return -1;
 }
@@ -52,23 +81,51 @@ argint(int n, int *ip)
   return fetchint((myproc()->tf->esp) + 4 + 4*n, ip);
 }
 
-// Fetch the nth word-sized system call argument as a pointer
-// to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
-int
-argptr(int n, char **pp, int size)
+static int
+fetchptr(int n, char **pp, int size, int write)
 {
   int i;
   struct proc *curproc = myproc();
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0)
+    return -1;
+  if(((uint)i >= curproc->sz || (uint)i+size > curproc->sz) &&
+     !mmapvalid(curproc, i, size, write))
+    return -1;
+  // Bring the pages in now, and keep swapout() from taking
+  // them: the kernel may copy to or from them with a spinlock
+  // held, when it can't wait for the disk.
+  if(curproc->npin == NPIN)
+    return -1;
+  curproc->pinva[curproc->npin] = i;
+  curproc->pinlen[curproc->npin] = size;
+  curproc->npin++;
+  if(pagein(curproc, i, size, write) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
 }
 
+// Fetch the nth word-sized system call argument as a pointer
+// to a block of memory of size bytes.  Check that the pointer
+// lies within the process address space or a writable file
+// mapping.
+int
+argptr(int n, char **pp, int size)
+{
+  return fetchptr(n, pp, size, 1);
+}
+
+// Like argptr, for a block the kernel only reads, which may
+// also lie in a read-only file mapping.
+int
+argrdptr(int n, char **pp, int size)
+{
+  return fetchptr(n, pp, size, 0);
+}
+
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
 // (There is no shared writable memory, so the string can't change
@@ -113,6 +170,20 @@ extern int sys_set_schedule_queue(void);
 extern int sys_set_HRRN_priority_proc(void);
 extern int sys_set_HRRN_priority_sys(void);
 extern int sys_print_info(void);
+extern int sys_schedstat(void);
+extern int sys_set_queue_quantum(void);
+extern int sys_nanosleep(void);
+extern int sys_set_affinity(void);
+extern int sys_get_affinity(void);
+extern int sys_largepages(void);
+extern int sys_vmstat(void);
+extern int sys_shm_open(void);
+extern int sys_shm_attach(void);
+extern int sys_shm_detach(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_meminfo(void);
+extern int sys_shm_unlink(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -146,6 +217,20 @@ static int (*syscalls[])(void) = {
 [SYS_set_HRRN_priority_proc]    sys_set_HRRN_priority_proc,
 [SYS_set_HRRN_priority_sys]     sys_set_HRRN_priority_sys,
 [SYS_print_info]                sys_print_info,
+[SYS_schedstat]                 sys_schedstat,
+[SYS_set_queue_quantum]         sys_set_queue_quantum,
+[SYS_nanosleep]                 sys_nanosleep,
+[SYS_set_affinity]              sys_set_affinity,
+[SYS_get_affinity]              sys_get_affinity,
+[SYS_largepages]                sys_largepages,
+[SYS_vmstat]                    sys_vmstat,
+[SYS_shm_open]                  sys_shm_open,
+[SYS_shm_attach]                sys_shm_attach,
+[SYS_shm_detach]                sys_shm_detach,
+[SYS_mmap]                      sys_mmap,
+[SYS_munmap]                    sys_munmap,
+[SYS_meminfo]                   sys_meminfo,
+[SYS_shm_unlink]                sys_shm_unlink,
 };
 
 void
@@ -155,6 +240,7 @@ syscall(void)
   struct proc *curproc = myproc();
 
   num = curproc->tf->eax;
+  curproc->npin = 0;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     curproc->tf->eax = syscalls[num]();
   } else {
@@ -30,4 +30,18 @@
 #define SYS_set_HRRN_priority_proc 28
 #define SYS_set_HRRN_priority_sys 29
 #define SYS_print_info 30
+#define SYS_schedstat 31
+#define SYS_set_queue_quantum 32
+#define SYS_nanosleep 33
+#define SYS_set_affinity 34
+#define SYS_get_affinity 35
+#define SYS_largepages 36
+#define SYS_vmstat 37
+#define SYS_shm_open 38
+#define SYS_shm_attach 39
+#define SYS_shm_detach 40
+#define SYS_mmap 41
+#define SYS_munmap 42
+#define SYS_meminfo 43
+#define SYS_shm_unlink 44
 
@@ -85,7 +85,7 @@ sys_write(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argrdptr(1, &p, n) < 0)
     return -1;
   return filewrite(f, p, n);
 }
@@ -466,4 +466,29 @@ sys_get_file_sectors(void)
     addrs[i] = call_bmap(ip, i);
   
   return bn;
-}
\ No newline at end of file
+}
+
+// Map part of an open file into memory.
+int
+sys_mmap(void)
+{
+  struct file *f;
+  int off, len, prot;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &off) < 0 || argint(2, &len) < 0 ||
+     argint(3, &prot) < 0)
+    return -1;
+  if(off < 0 || len <= 0 || prot == 0 || (prot & ~(PROT_READ|PROT_WRITE)))
+    return -1;
+  return mmap(f, off, len, prot);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  return munmap(addr, len);
+}
@@ -6,6 +6,9 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "schedstat.h"
+#include "vmstat.h"
+#include "meminfo.h"
 
 int
 sys_fork(void)
@@ -60,20 +63,30 @@ int
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
+
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n <= 0)
+    return 0;
+  return sleepuntil(rdtsc() + ticks2tsc(n));
+}
+
+// Sleep for sec seconds plus nsec nanoseconds, rounded down
+// to whole microseconds.  A deadline between two ticks gets
+// its own one-shot timer interrupt, so the wakeup comes within
+// about a microsecond of it, plus the time to be scheduled.
+int
+sys_nanosleep(void)
+{
+  int sec, nsec;
+  uint64 deadline;
+
+  if(argint(0, &sec) < 0 || argint(1, &nsec) < 0)
+    return -1;
+  if(sec < 0 || nsec < 0 || nsec >= 1000000000)
+    return -1;
+  deadline = rdtsc() + us2tsc(sec) * 1000000 + us2tsc(nsec / 1000);
+  return sleepuntil(deadline);
 }
 
 // return how many clock tick interrupts have occurred
@@ -144,10 +157,50 @@ sys_set_schedule_queue(void)
     return -1;
   if(argint(1, &scheduler_queue) < 0)
     return -1;
+  if(scheduler_queue < 1 || scheduler_queue > 3)
+    return -1;
   set_schedule_queue(pid, scheduler_queue);
   return 1;
 }
 
+int
+sys_set_queue_quantum(void)
+{
+  int scheduler_queue;
+  int nticks;
+  if(argint(0, &scheduler_queue) < 0)
+    return -1;
+  if(argint(1, &nticks) < 0)
+    return -1;
+  if(scheduler_queue < 1 || scheduler_queue > 3)
+    return -1;
+  if(nticks < 1 || nticks > MAXQUANTUM)
+    return -1;
+  set_queue_quantum(scheduler_queue, nticks);
+  return 1;
+}
+
+int
+sys_set_affinity(void)
+{
+  int pid;
+  int mask;
+  if(argint(0, &pid) < 0)
+    return -1;
+  if(argint(1, &mask) < 0)
+    return -1;
+  return set_affinity(pid, mask);
+}
+
+int
+sys_get_affinity(void)
+{
+  int pid;
+  if(argint(0, &pid) < 0)
+    return -1;
+  return get_affinity(pid);
+}
+
 int
 sys_set_HRRN_priority_proc(void)
 {
@@ -176,4 +229,85 @@ sys_print_info(void)
 {
   print_info();
   return 1;
-}
\ No newline at end of file
+}
+
+int
+sys_schedstat(void)
+{
+  int pid;
+  struct schedstat *st;
+  if(argint(0, &pid) < 0)
+    return -1;
+  if(argptr(1, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  return schedstat(pid, st);
+}
+
+// Turn 4MB pages for large untouched heap regions on or off
+// for the calling process.
+int
+sys_largepages(void)
+{
+  int on;
+  if(argint(0, &on) < 0)
+    return -1;
+  myproc()->largepages = (on != 0);
+  return 0;
+}
+
+int
+sys_vmstat(void)
+{
+  struct vmstat *st;
+  if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  vmstat(st);
+  return 0;
+}
+
+int
+sys_meminfo(void)
+{
+  struct meminfo *mi;
+  if(argptr(0, (void*)&mi, sizeof(*mi)) < 0)
+    return -1;
+  meminfo(mi);
+  return 0;
+}
+
+// Find or create the shared memory segment with a key.
+int
+sys_shm_open(void)
+{
+  int key, size;
+  if(argint(0, &key) < 0 || argint(1, &size) < 0 || size < 0)
+    return -1;
+  return shmopen(key, size);
+}
+
+int
+sys_shm_attach(void)
+{
+  int id;
+  if(argint(0, &id) < 0)
+    return -1;
+  return shmattach(id);
+}
+
+int
+sys_shm_detach(void)
+{
+  int va;
+  if(argint(0, &va) < 0)
+    return -1;
+  return shmdetach(va);
+}
+
+int
+sys_shm_unlink(void)
+{
+  int key;
+  if(argint(0, &key) < 0)
+    return -1;
+  return shmunlink(key);
+}
@@ -0,0 +1,267 @@
+// Timed sleeps.
+//
+// Processes in sleep() or nanosleep() sit on a min-heap ordered
+// by their deadline in TSC cycles.  Every CPU's timer interrupt
+// pops and wakes only the sleepers whose deadline has passed,
+// instead of every sleeper re-checking the clock on every tick.
+// The TSC rate is calibrated against the 8253 PIT at boot, and
+// the length of a tick is measured from CPU 0's timer interrupts.
+//
+// When the earliest deadline falls before a CPU's next tick,
+// the CPU turns its LAPIC timer into a one-shot that fires at
+// the deadline with vector IRQ_HRTIMER.  hrtimerintr() then
+// aims the next one-shot at the following deadline, or at the
+// tick that was skipped, and that tick goes back to periodic.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "traps.h"
+
+#define IO_PIT2         0x42    // 8253 channel 2 counter
+#define IO_PITCTL       0x43    // 8253 mode control
+#define IO_PORTB        0x61    // Channel 2 gate (bit 0) and output (bit 5)
+#define PIT_HZ          1193182
+#define CALIBMS         10      // Length of the calibration run
+
+static struct {
+  struct spinlock lock;
+  int n;
+  struct proc *heap[NPROC];
+} timers;
+
+static uint tsc_per_us;         // TSC cycles per microsecond
+static uint tsc_per_tick;       // TSC cycles between timer interrupts
+static uint64 lasttick;         // rdtsc() at CPU 0's last timer interrupt
+
+static void
+timer_swap(int i, int j)
+{
+  struct proc *p = timers.heap[i];
+
+  timers.heap[i] = timers.heap[j];
+  timers.heap[j] = p;
+  timers.heap[i]->timer_index = i;
+  timers.heap[j]->timer_index = j;
+}
+
+static void
+timer_up(int i)
+{
+  while(i > 0 && timers.heap[i]->deadline < timers.heap[(i-1)/2]->deadline){
+    timer_swap(i, (i-1)/2);
+    i = (i-1)/2;
+  }
+}
+
+static void
+timer_down(int i)
+{
+  int c;
+
+  for(;;){
+    c = 2*i + 1;
+    if(c >= timers.n)
+      break;
+    if(c+1 < timers.n && timers.heap[c+1]->deadline < timers.heap[c]->deadline)
+      c++;
+    if(timers.heap[i]->deadline <= timers.heap[c]->deadline)
+      break;
+    timer_swap(i, c);
+    i = c;
+  }
+}
+
+static void
+timer_remove(struct proc *p)
+{
+  int i = p->timer_index;
+
+  timers.n--;
+  if(i != timers.n){
+    timers.heap[i] = timers.heap[timers.n];
+    timers.heap[i]->timer_index = i;
+    timer_down(i);
+    timer_up(i);
+  }
+  p->timer_index = -1;
+}
+
+void
+timerinit(void)
+{
+  uint64 t0, t1;
+  uint latch, i;
+
+  initlock(&timers.lock, "timers");
+
+  // Let PIT channel 2 count down CALIBMS milliseconds once,
+  // with the speaker off, and see how far the TSC moves.
+  latch = PIT_HZ / 1000 * CALIBMS;
+  outb(IO_PORTB, (inb(IO_PORTB) & ~0x02) | 0x01);
+  outb(IO_PITCTL, 0xB0);        // channel 2, lo/hi byte, mode 0
+  outb(IO_PIT2, latch & 0xFF);
+  outb(IO_PIT2, latch >> 8);
+  t0 = rdtsc();
+  for(i = 0; i < 10000000 && (inb(IO_PORTB) & 0x20) == 0; i++)
+    ;
+  t1 = rdtsc();
+
+  tsc_per_us = (uint)(t1 - t0) / (CALIBMS * 1000);
+  if(tsc_per_us == 0)
+    tsc_per_us = 1;
+  // Nominal 100 Hz until CPU 0 has seen two ticks.
+  tsc_per_tick = tsc_per_us * 10000;
+}
+
+// The fraction of a tick, in 65536ths, that t TSC cycles take.
+static uint
+tickfrac(uint64 t)
+{
+  uint per;
+
+  per = tsc_per_tick >> 16;
+  if(per == 0)
+    per = 1;
+  if(t >= tsc_per_tick)
+    return 1 << 16;
+  return (uint)t / per;
+}
+
+// Make this CPU's next timer interrupt a one-shot at TSC time
+// when, with vector T_IRQ0+irq.
+static void
+timer_oneshot(uint64 now, uint64 when, int irq)
+{
+  mycpu()->oneshot = 1;
+  lapiconeshot(tickfrac(when > now ? when - now : 0), irq);
+}
+
+// Aim this CPU's timer at the earliest deadline if it comes
+// before the CPU's next tick and any deadline already set.
+// Caller holds timers.lock.
+static void
+timer_arm(uint64 now)
+{
+  struct cpu *c = mycpu();
+  uint64 d;
+
+  if(timers.n == 0)
+    return;
+  d = timers.heap[0]->deadline;
+  if(d >= c->nexttick || (c->hrdeadline && c->hrdeadline <= d))
+    return;
+  c->hrdeadline = d;
+  timer_oneshot(now, d, IRQ_HRTIMER);
+}
+
+// Wake the sleepers whose deadline has passed.
+// Caller holds timers.lock.
+static void
+timer_wake(uint64 now)
+{
+  struct proc *p;
+
+  while(timers.n > 0 && timers.heap[0]->deadline <= now){
+    p = timers.heap[0];
+    timer_remove(p);
+    wakeup(&p->deadline);
+  }
+}
+
+// Convert n timer ticks to TSC cycles.
+uint64
+ticks2tsc(uint n)
+{
+  return (uint64)n * tsc_per_tick;
+}
+
+// Convert microseconds to TSC cycles.
+uint64
+us2tsc(uint us)
+{
+  return (uint64)us * tsc_per_us;
+}
+
+// Sleep until rdtsc() reaches deadline.
+// Returns -1 if the process is killed first.
+int
+sleepuntil(uint64 deadline)
+{
+  struct proc *p = myproc();
+
+  if(rdtsc() >= deadline)
+    return 0;
+
+  acquire(&timers.lock);
+  p->deadline = deadline;
+  p->timer_index = timers.n;
+  timers.heap[timers.n++] = p;
+  timer_up(p->timer_index);
+  timer_arm(rdtsc());
+  while(p->timer_index >= 0){
+    if(p->killed){
+      timer_remove(p);
+      release(&timers.lock);
+      return -1;
+    }
+    sleep(&p->deadline, &timers.lock);
+  }
+  release(&timers.lock);
+  return 0;
+}
+
+// Called from every CPU's timer interrupt.
+// Wakes the sleepers whose deadline has passed.
+void
+timertick(void)
+{
+  struct cpu *c = mycpu();
+  uint64 now;
+
+  now = rdtsc();
+  if(cpuid() == 0){
+    // Keep a running average; a single interval jitters.
+    if(lasttick)
+      tsc_per_tick = (tsc_per_tick*7 + (uint)(now - lasttick)) / 8;
+    lasttick = now;
+  }
+  c->nexttick = now + tsc_per_tick;
+
+  if(timers.n == 0 && !c->oneshot)
+    return;
+  acquire(&timers.lock);
+  if(c->oneshot){
+    // This tick was a one-shot; it may also have cut short
+    // one aimed at a deadline, which timer_arm() sets again.
+    lapicperiodic();
+    c->oneshot = 0;
+    c->hrdeadline = 0;
+  }
+  timer_wake(now);
+  timer_arm(now);
+  release(&timers.lock);
+}
+
+// Called from the one-shot timer interrupt set by timer_arm().
+void
+hrtimerintr(void)
+{
+  struct cpu *c = mycpu();
+  uint64 now;
+
+  now = rdtsc();
+  acquire(&timers.lock);
+  c->hrdeadline = 0;
+  timer_wake(now);
+  timer_arm(now);
+  // Nothing else is due before the next tick; let it come.
+  if(c->hrdeadline == 0)
+    timer_oneshot(now, c->nexttick, IRQ_TIMER);
+  release(&timers.lock);
+}
@@ -51,9 +51,18 @@ trap(struct trapframe *tf)
     if(cpuid() == 0){
       acquire(&tickslock);
       ticks++;
-      wakeup(&ticks);
       release(&tickslock);
     }
+    timertick();
+    schedtick();
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_HRTIMER:
+    hrtimerintr();
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_RESCHED:
+    // Only here to wake a halted scheduler().
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -78,6 +87,11 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    if(myproc() && pagefault(myproc(), rcr2(), tf->err) == 0)
+      break;
+    // Not one we can fix; treat it like any other trap.
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -100,10 +114,11 @@ trap(struct trapframe *tf)
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU once it has used up the
+  // time slice of its scheduling queue.
   // If interrupts were on while locks held, would need to check nlock.
   if(myproc() && myproc()->state == RUNNING &&
-     tf->trapno == T_IRQ0+IRQ_TIMER)
+     tf->trapno == T_IRQ0+IRQ_TIMER && slice_expired(myproc()))
     yield();
 
   // Check if the process has been killed since we yielded
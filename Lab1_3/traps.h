@@ -34,5 +34,7 @@
 #define IRQ_COM1         4
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_RESCHED     20      // reschedule IPI, wakes a halted CPU
+#define IRQ_HRTIMER     21      // one-shot LAPIC timer for a sleep deadline
 #define IRQ_SPURIOUS    31
 
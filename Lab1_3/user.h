@@ -1,5 +1,8 @@
 struct stat;
 struct rtcdate;
+struct schedstat;
+struct vmstat;
+struct meminfo;
 
 // system calls
 int fork(void);
@@ -32,6 +35,20 @@ int set_HRRN_priority_sys(int);
 int set_HRRN_priority_proc(int, int);
 int set_schedule_queue(int, int);
 int print_info(void);
+int schedstat(int, struct schedstat*);
+int set_queue_quantum(int, int);
+int nanosleep(int, int);
+int set_affinity(int, int);
+int get_affinity(int);
+int largepages(int);
+int vmstat(struct vmstat*);
+int shm_open(int, int);
+char* shm_attach(int);
+int shm_detach(void*);
+char* mmap(int, int, int, int);
+int munmap(void*, int);
+int meminfo(struct meminfo*);
+int shm_unlink(int);
 
 
 // ulib.c
@@ -6,11 +6,17 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "fs.h"
+#include "vmstat.h"
+#include "meminfo.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
 
-// Set up CPU's kernel segment descriptors.
+static int splitlarge(pde_t*, uint);
+
+// Set up CPU's kernel segment descriptors, and turn on global
+// pages so kernel TLB entries survive address space switches.
 // Run once on entry on each CPU.
 void
 seginit(void)
@@ -27,11 +33,13 @@ seginit(void)
   c->gdt[SEG_UCODE] = SEG(STA_X|STA_R, 0, 0xffffffff, DPL_USER);
   c->gdt[SEG_UDATA] = SEG(STA_W, 0, 0xffffffff, DPL_USER);
   lgdt(c->gdt, sizeof(c->gdt));
+  lcr4(rcr4() | CR4_PGE);
 }
 
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
-// create any required page table pages.
+// create any required page table pages.  va must not be
+// in a 4MB page; callers check for PTE_PS first.
 static pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
@@ -39,13 +47,15 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    panic("walkpgdir: large page");
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!alloc || (pgtab = (pte_t*)kzalloc()) == 0)
+      return 0;
+    kcharge((char*)pgtab, MEM_PGTBL);
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -114,6 +124,31 @@ static struct kmap {
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
+// Map a kmap entry: with 4MB pages where va and pa are both
+// 4MB-aligned and a whole 4MB is left, 4KB pages elsewhere
+// (around the read-only kernel text).  The entries are the
+// same in every page table, so they are global.
+static int
+mapkvm(pde_t *pgdir, uint va, uint size, uint pa, int perm)
+{
+  uint n;
+
+  while(size > 0){
+    if(va % LPGSIZE == 0 && pa % LPGSIZE == 0 && size >= LPGSIZE){
+      pgdir[PDX(va)] = pa | perm | PTE_P | PTE_PS | PTE_G;
+      n = LPGSIZE;
+    } else {
+      if(mappages(pgdir, (void*)va, PGSIZE, pa, perm | PTE_G) < 0)
+        return -1;
+      n = PGSIZE;
+    }
+    va += n;
+    pa += n;
+    size -= n;
+  }
+  return 0;
+}
+
 // Set up kernel part of a page table.
 pde_t*
 setupkvm(void)
@@ -121,14 +156,14 @@ setupkvm(void)
   pde_t *pgdir;
   struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kzalloc()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
+  kcharge((char*)pgdir, MEM_PGTBL);
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
+    if(mapkvm(pgdir, (uint)k->virt, k->phys_end - k->phys_start,
+              (uint)k->phys_start, k->perm) < 0) {
       freevm(pgdir);
       return 0;
     }
@@ -174,6 +209,7 @@ switchuvm(struct proc *p)
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
   lcr3(V2P(p->pgdir));  // switch to process's address space
+  mycpu()->cr3loads++;
   popcli();
 }
 
@@ -186,36 +222,12 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kzalloc();
+  kcharge(mem, MEM_USER);
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
-int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
-{
-  uint i, pa, n;
-  pte_t *pte;
-
-  if((uint) addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, P2V(pa), offset+i, n) != n)
-      return -1;
-  }
-  return 0;
-}
-
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int
@@ -224,20 +236,19 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   char *mem;
   uint a;
 
-  if(newsz >= KERNBASE)
+  if(newsz > MMAPBASE)
     return 0;
   if(newsz < oldsz)
     return oldsz;
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = allocuser(1);
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -263,6 +274,20 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(newsz);
   for(; a  < oldsz; a += PGSIZE){
+    if(pgdir[PDX(a)] & PTE_PS){
+      if(a % LPGSIZE == 0 && a + LPGSIZE <= oldsz){
+        kfree_order(P2V(PTE_ADDR(pgdir[PDX(a)])), LPGORDER);
+        pgdir[PDX(a)] = 0;
+        a += LPGSIZE - PGSIZE;
+        continue;
+      }
+      // Freeing part of it: split it and free that part page
+      // by page.  Without memory to split, keep it mapped.
+      if(splitlarge(pgdir, a) < 0){
+        a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+        continue;
+      }
+    }
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
@@ -273,6 +298,9 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       char *v = P2V(pa);
       kfree(v);
       *pte = 0;
+    } else if(*pte & PTE_SWAP){
+      swapfree(PTE_ADDR(*pte) / PGSIZE);
+      *pte = 0;
     }
   }
   return newsz;
@@ -289,7 +317,7 @@ freevm(pde_t *pgdir)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
   for(i = 0; i < NPDENTRIES; i++){
-    if(pgdir[i] & PTE_P){
+    if((pgdir[i] & PTE_P) && !(pgdir[i] & PTE_PS)){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
     }
@@ -310,37 +338,326 @@ clearpteu(pde_t *pgdir, char *uva)
   *pte &= ~PTE_U;
 }
 
+// Map the n pages pages[] at va in pgdir with permissions perm,
+// shared rather than copy-on-write.  Each mapping holds a
+// reference to its page, which deallocuvm() drops.
+int
+mapshared(pde_t *pgdir, uint va, char **pages, uint n, int perm)
+{
+  uint i;
+
+  for(i = 0; i < n; i++){
+    if(mappages(pgdir, (char*)va + i*PGSIZE, PGSIZE, V2P(pages[i]), perm) < 0){
+      deallocuvm(pgdir, va + i*PGSIZE, va);
+      return -1;
+    }
+    kref(pages[i]);
+  }
+  return 0;
+}
+
+// Return the kernel address of the page mapped at va in pgdir,
+// or 0 if there is none, and its PTE flags in *flags.
+char*
+uvapage(pde_t *pgdir, uint va, uint *flags)
+{
+  pte_t *pte;
+
+  if(pgdir[PDX(va)] & PTE_PS)
+    return 0;
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  if(pte == 0 || !(*pte & PTE_P))
+    return 0;
+  *flags = PTE_FLAGS(*pte);
+  return P2V(PTE_ADDR(*pte));
+}
+
+// Reload CR3 to drop stale TLB entries of pgdir, which must be
+// the current page table.  Kernel entries are global and stay.
+void
+flushtlb(pde_t *pgdir)
+{
+  pushcli();
+  lcr3(V2P(pgdir));
+  mycpu()->tlbflushes++;
+  popcli();
+}
+
+// Turn the 4MB page holding va into a page table of 4KB pages,
+// which are ordinary pages from then on.  The mappings don't
+// change, so there is nothing to flush.
+static int
+splitlarge(pde_t *pgdir, uint va)
+{
+  pde_t *pde;
+  pte_t *pgtab;
+  uint pa, flags, i;
+
+  pde = &pgdir[PDX(va)];
+  if((pgtab = (pte_t*)kzalloc()) == 0)
+    return -1;
+  kcharge((char*)pgtab, MEM_PGTBL);
+  pa = PTE_ADDR(*pde);
+  flags = PTE_FLAGS(*pde) & ~(PTE_PS | PTE_G);
+  ksplit(P2V(pa), LPGORDER);
+  for(i = 0; i < NPTENTRIES; i++){
+    kref(P2V(pa + i*PGSIZE));
+    pgtab[i] = (pa + i*PGSIZE) | flags;
+  }
+  *pde = V2P(pgtab) | PTE_P | PTE_W | PTE_U;
+  pushcli();
+  mycpu()->lpgsplits++;
+  popcli();
+  return 0;
+}
+
+// Map a whole zeroed 4MB page over the untouched 4MB region
+// holding va, if the region is all heap below p->sz.
+static int
+largefault(struct proc *p, uint va)
+{
+  struct segment *sg;
+  uint base;
+  char *mem;
+
+  base = va & ~(LPGSIZE-1);
+  if(p->pgdir[PDX(va)] != 0 || base + LPGSIZE > p->sz)
+    return -1;
+  for(sg = p->seg; sg < &p->seg[p->nseg]; sg++)
+    if(sg->vaddr < base + LPGSIZE && base < sg->vaddr + sg->memsz)
+      return -1;
+  if((mem = kalloc_order(LPGORDER)) == 0)
+    return -1;
+  kcharge(mem, MEM_USER);
+  memset(mem, 0, LPGSIZE);
+  p->pgdir[PDX(va)] = V2P(mem) | PTE_P | PTE_W | PTE_U | PTE_PS;
+  pushcli();
+  mycpu()->lpgfaults++;
+  popcli();
+  return 0;
+}
+
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child.  Pages are not copied: writable ones are
+// made read-only and PTE_COW in both page tables, and
+// pagefault() copies them on the first write.
 pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
-  pte_t *pte;
+  pte_t *pte, *npte;
   uint pa, i, flags;
-  char *mem;
 
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
+    // Share 4MB pages as ordinary pages.
+    if((pgdir[PDX(i)] & PTE_PS) && splitlarge(pgdir, i) < 0)
+      goto bad;
+    // Heap pages not touched yet are left out here too.
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+      continue;
+    if(*pte & PTE_SWAP){
+      // Both share the copy in swap.
+      if((npte = walkpgdir(d, (void *) i, 1)) == 0)
+        goto bad;
+      swapdup(PTE_ADDR(*pte) / PGSIZE);
+      *npte = *pte;
+      continue;
+    }
     if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+      continue;
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
       goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-      kfree(mem);
-      goto bad;
-    }
+    kref(P2V(pa));
   }
+  flushtlb(pgdir);  // the parent's entries are now read-only
   return d;
 
 bad:
   freevm(d);
+  flushtlb(pgdir);
+  return 0;
+}
+
+// Read the part of the page at va that p's executable backs
+// into mem, which is zeroed.  Pages outside every segment,
+// such as the heap, stay zero.
+static int
+loadseg(struct proc *p, uint va, char *mem)
+{
+  struct segment *sg;
+  uint n, ra;
+
+  if(p->exe == 0)
+    return 0;
+  for(sg = p->seg; sg < &p->seg[p->nseg]; sg++){
+    if(va < sg->vaddr || va - sg->vaddr >= sg->memsz)
+      continue;
+    if(va - sg->vaddr >= sg->filesz)
+      return 0;
+    n = sg->filesz - (va - sg->vaddr);
+    if(n > PGSIZE)
+      n = PGSIZE;
+    ilock(p->exe);
+    // The rest of the segment is likely to be touched soon.
+    ra = sg->filesz - (va - sg->vaddr) - n;
+    if(ra > RAMAX*BSIZE)
+      ra = RAMAX*BSIZE;
+    readahead(p->exe, sg->off + (va - sg->vaddr) + n, ra);
+    if(readi(p->exe, mem, sg->off + (va - sg->vaddr), n) != n){
+      iunlock(p->exe);
+      return -1;
+    }
+    iunlock(p->exe);
+    return 0;
+  }
+  return 0;
+}
+
+// Handle a page fault at va in p's address space, with error
+// code err.  A page below p->sz that nobody has touched yet
+// gets a zeroed page, read in from the executable if exec()
+// left it to be paged in, and a page in swap is read back.
+// mmapfault() handles file mappings.  A write to a PTE_COW
+// page gets a private copy of the page, or the page itself
+// once nobody else shares it.
+// Returns -1 if the fault is not one of those.
+int
+pagefault(struct proc *p, uint va, uint err)
+{
+  pde_t *pgdir = p->pgdir;
+  pte_t *pte;
+  uint pa, flags;
+  char *mem;
+
+  pushcli();
+  mycpu()->pgfaults++;
+  popcli();
+  if(va >= KERNBASE || (pgdir[PDX(va)] & PTE_PS))
+    return -1;
+  va = PGROUNDDOWN(va);
+  pte = walkpgdir(pgdir, (void*)va, 0);
+  if(pte && (*pte & PTE_SWAP)){
+    if((mem = allocuser(0)) == 0)
+      return -1;
+    swapread(PTE_ADDR(*pte) / PGSIZE, mem);
+    swapfree(PTE_ADDR(*pte) / PGSIZE);
+    *pte = V2P(mem) | PTE_P | PTE_W | PTE_U;
+    return 0;
+  }
+  if(pte == 0 || !(*pte & PTE_P)){
+    if(va >= p->sz)
+      return mmapfault(p, va, err);
+    if(p->largepages && pte == 0 && largefault(p, va) == 0)
+      return 0;
+    if((mem = allocuser(1)) == 0)
+      return -1;
+    if(loadseg(p, va, mem) < 0 ||
+       mappages(pgdir, (char*)va, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+      kfree(mem);
+      return -1;
+    }
+    return 0;
+  }
+  if(!(err & FEC_WR) || !(*pte & PTE_COW))
+    return -1;
+  pa = PTE_ADDR(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  if(krefcount(P2V(pa)) == 1)
+    *pte = pa | flags;
+  else {
+    if((mem = allocuser(0)) == 0)
+      return -1;
+    memmove(mem, (char*)P2V(pa), PGSIZE);
+    *pte = V2P(mem) | flags;
+    kfree(P2V(pa));
+  }
+  flushtlb(pgdir);
+  return 0;
+}
+
+// Does page va hold part of a buffer that p's current system
+// call may use with a spinlock held?
+static int
+pinned(struct proc *p, uint va)
+{
+  int i;
+
+  for(i = 0; i < p->npin; i++)
+    if(va < p->pinva[i] + p->pinlen[i] && p->pinva[i] < va + PGSIZE)
+      return 1;
+  return 0;
+}
+
+// Move the clock hand *va over p's pages below p->sz, for
+// swapvictim().  A page used since the hand last passed loses
+// PTE_A and gets a second chance; the first page that was not
+// used is unmapped, its PTE pointing at a new swap slot in
+// *slot, and returned with the mapping's reference.  Only
+// private, writable pages outside p's pinned buffers are taken.
+// Returns 0 when the hand reaches p->sz or swap is full.
+// p must not be running, so it has no TLB entries to flush.
+char*
+clockscan(struct proc *p, uint *va, int *slot)
+{
+  pde_t *pde;
+  pte_t *pte;
+  char *mem;
+
+  for(; *va < p->sz; *va += PGSIZE){
+    pde = &p->pgdir[PDX(*va)];
+    if(!(*pde & PTE_P) || (*pde & PTE_PS)){
+      *va = PGADDR(PDX(*va) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    pte = walkpgdir(p->pgdir, (char*)*va, 0);
+    if((*pte & (PTE_P|PTE_W|PTE_U)) != (PTE_P|PTE_W|PTE_U) || pinned(p, *va))
+      continue;
+    mem = P2V(PTE_ADDR(*pte));
+    if(krefcount(mem) != 1)
+      continue;
+    if(*pte & PTE_A){
+      *pte &= ~PTE_A;
+      continue;
+    }
+    if((*slot = swapalloc()) < 0)
+      return 0;
+    *pte = (*slot * PGSIZE) | PTE_SWAP;
+    *va += PGSIZE;
+    return mem;
+  }
+  return 0;
+}
+
+// Fault in any pages of [va, va+n) in p that are not mapped
+// yet and, if the kernel will write them, give p its own copy
+// of any PTE_COW page, so that copying to or from them later
+// cannot fault.
+int
+pagein(struct proc *p, uint va, uint n, int write)
+{
+  pte_t *pte;
+  uint a, err;
+
+  err = write ? FEC_WR : 0;
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    if(p->pgdir[PDX(a)] & PTE_PS)
+      continue;
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if((pte == 0 || !(*pte & PTE_P)) && pagefault(p, a, err) < 0)
+      return -1;
+    // The fault may have mapped a whole 4MB page, which is never COW.
+    if(p->pgdir[PDX(a)] & PTE_PS)
+      continue;
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(write && (*pte & PTE_COW) && pagefault(p, a, FEC_WR) < 0)
+      return -1;
+  }
   return 0;
 }
 
@@ -385,10 +702,62 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   return 0;
 }
 
+// Count the user pages mapped in pgdir: its resident set.
+uint
+rss(pde_t *pgdir)
+{
+  pte_t *pgtab;
+  uint i, j, n;
+
+  n = 0;
+  for(i = 0; i < PDX(KERNBASE); i++){
+    if(!(pgdir[i] & PTE_P))
+      continue;
+    if(pgdir[i] & PTE_PS){
+      n += NPTENTRIES;
+      continue;
+    }
+    pgtab = (pte_t*)P2V(PTE_ADDR(pgdir[i]));
+    for(j = 0; j < NPTENTRIES; j++)
+      if((pgtab[j] & (PTE_P|PTE_U)) == (PTE_P|PTE_U))
+        n++;
+  }
+  return n;
+}
+
+// Fill in *st for the vmstat system call.
+void
+vmstat(struct vmstat *st)
+{
+  pte_t *pgtab;
+  uint i, j;
+
+  memset(st, 0, sizeof(*st));
+  for(i = PDX(KERNBASE); i < NPDENTRIES; i++){
+    if(kpgdir[i] & PTE_PS)
+      st->kmap4m++;
+    else if(kpgdir[i] & PTE_P){
+      pgtab = (pte_t*)P2V(PTE_ADDR(kpgdir[i]));
+      for(j = 0; j < NPTENTRIES; j++)
+        if(pgtab[j] & PTE_P)
+          st->kmap4k++;
+    }
+  }
+  st->cached = kfreeblocks(st->freeblocks);
+  swapstat(st);
+  st->ncpu = ncpu;
+  for(i = 0; i < ncpu; i++){
+    st->cpu[i].cr3loads = cpus[i].cr3loads;
+    st->cpu[i].tlbflushes = cpus[i].tlbflushes;
+    st->cpu[i].pgfaults = cpus[i].pgfaults;
+    st->cpu[i].lpgfaults = cpus[i].lpgfaults;
+    st->cpu[i].lpgsplits = cpus[i].lpgsplits;
+  }
+}
+
 //PAGEBREAK!
 // Blank page.
 //PAGEBREAK!
 // Blank page.
 //PAGEBREAK!
 // Blank page.
-
@@ -0,0 +1,50 @@
+#include "param.h"
+#include "types.h"
+#include "user.h"
+#include "vmstat.h"
+
+// Usage: vmstat
+// Prints how the kernel map is built, the free blocks of the
+// buddy allocator, swap use, and the per-CPU paging counters.
+
+struct vmstat st;
+
+// For each order, how many free blocks there are and what
+// percentage of free memory is in smaller blocks, so can't
+// satisfy an allocation of that order.
+void print_buddy(void)
+{
+    uint total = 0, below = 0;
+
+    for (int i = 0; i <= MAXORDER; i++)
+        total += st.freeblocks[i] << i;
+    printf(1, "free pages: %d in the buddy allocator, %d cached\n", total, st.cached);
+    printf(1, "order  blocks      unusable%%\n");
+    for (int i = 0; i <= MAXORDER; i++)
+    {
+        printf(1, "%d      %d    %d\n", i, st.freeblocks[i], total ? below * 100 / total : 0);
+        below += st.freeblocks[i] << i;
+    }
+    printf(1, "\n");
+}
+
+int main(int argc, char* argv[])
+{
+    if (vmstat(&st) < 0)
+    {
+        printf(1, "vmstat failed\n");
+        exit();
+    }
+    printf(1, "kernel map: %d 4MB pages, %d 4KB pages\n", st.kmap4m, st.kmap4k);
+    print_buddy();
+    printf(1, "swap: %d of %d pages used, %d swapped in, %d swapped out\n\n",
+           st.swapused, st.swapslots, st.swapins, st.swapouts);
+    printf(1, "cpu  cr3loads    tlbflushes  pgfaults    lpgfaults   lpgsplits\n");
+    for (int i = 0; i < st.ncpu; i++)
+    {
+        struct vmcpustat *c = &st.cpu[i];
+        printf(1, "%d    %d    %d    %d    %d    %d\n", i, c->cr3loads, c->tlbflushes,
+               c->pgfaults, c->lpgfaults, c->lpgsplits);
+    }
+    exit();
+}
@@ -0,0 +1,27 @@
+// Paging statistics, filled in by the vmstat system call.
+// There are no TLB miss counters to read under emulation, so
+// these count what causes misses instead: address space
+// switches and flushes, which drop every non-global entry, and
+// how much of memory is mapped with 4MB pages.
+
+// Per-CPU counters.
+struct vmcpustat {
+  uint cr3loads;           // Switches to a process's page table
+  uint tlbflushes;         // Other full flushes after PTE changes
+  uint pgfaults;           // Page faults handled or refused
+  uint lpgfaults;          // Faults that mapped a whole 4MB page
+  uint lpgsplits;          // 4MB user pages broken into 4KB pages
+};
+
+struct vmstat {
+  uint kmap4m;             // Kernel map entries that are 4MB pages
+  uint kmap4k;             // Kernel map entries that are 4KB pages
+  uint freeblocks[MAXORDER+1];  // Free blocks of 2^i pages
+  uint cached;             // Free pages held outside the buddy allocator
+  uint swapslots;          // Pages of swap space
+  uint swapused;           // Swap slots holding a page
+  uint swapins;            // Pages read back from swap
+  uint swapouts;           // Pages written to swap
+  int ncpu;
+  struct vmcpustat cpu[NCPU];
+};
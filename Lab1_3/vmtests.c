@@ -0,0 +1,428 @@
+// Tests of the virtual memory system: copy-on-write fork,
+// lazy sbrk, large pages, shared memory, file mappings and
+// swap.  Like usertests, each test prints OK or exits early
+// with a message saying what went wrong.
+
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "vmstat.h"
+#include "meminfo.h"
+
+char buf[8192];
+int stdout = 1;
+
+// does a write after fork() give the writer its own copy
+// of a copy-on-write page, in parent and child, including a
+// write by the kernel from read()?
+void
+cowtest(void)
+{
+  int fds[2], pid, i, n;
+  char *a, ok;
+
+  printf(stdout, "cow test\n");
+  a = sbrk(4*4096);
+  if(a == (char*)0xffffffff){
+    printf(stdout, "cow test sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < 4*4096; i++)
+    a[i] = 'p';
+  if(pipe(fds) != 0){
+    printf(stdout, "cow test pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "cow test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    ok = 1;
+    for(i = 0; i < 4096; i++){
+      if(a[i] != 'p')
+        ok = 0;
+      a[i] = 'c';
+    }
+    // the kernel writes the second page
+    for(n = 0; n < 4096; n += i)
+      if((i = read(fds[0], a + 4096 + n, 4096 - n)) <= 0)
+        break;
+    if(n != 4096)
+      ok = 0;
+    for(i = 0; i < 2*4096; i++)
+      if(a[i] != 'c')
+        ok = 0;
+    write(fds[1], &ok, 1);
+    exit();
+  }
+  memset(buf, 'c', 4096);
+  write(fds[1], buf, 4096);
+  wait();
+  if(read(fds[0], &ok, 1) != 1 || !ok){
+    printf(stdout, "cow test: child saw the wrong data\n");
+    exit();
+  }
+  // the parent writes the third page; nothing the child
+  // did shows through
+  for(i = 2*4096; i < 3*4096; i++)
+    a[i] = 'q';
+  for(i = 0; i < 4*4096; i++){
+    if(a[i] != (i >= 2*4096 && i < 3*4096 ? 'q' : 'p')){
+      printf(stdout, "cow test: parent saw the child's write\n");
+      exit();
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(-4*4096);
+  printf(stdout, "cow test OK\n");
+}
+
+// are sbrk()ed pages allocated only when touched, zeroed,
+// and usable as system call buffers before being touched?
+void
+lazysbrktest(void)
+{
+  int fds[2], i;
+  char *a, *p;
+  uint amt = 10*1024*1024;
+
+  printf(stdout, "lazy sbrk test\n");
+  a = sbrk(amt);
+  if(a == (char*)0xffffffff || sbrk(0) != a + amt){
+    printf(stdout, "lazy sbrk test sbrk failed\n");
+    exit();
+  }
+  for(p = a; p < a + amt; p += 1024*1024){
+    if(*p != 0){
+      printf(stdout, "lazy sbrk test: page not zeroed\n");
+      exit();
+    }
+    *p = 1;
+  }
+  if(pipe(fds) != 0){
+    printf(stdout, "lazy sbrk test pipe failed\n");
+    exit();
+  }
+  // write() from an untouched page, read() into another
+  if(write(fds[1], a + amt - 3*4096, 100) != 100 ||
+     read(fds[0], a + amt - 4096, 100) != 100){
+    printf(stdout, "lazy sbrk test: untouched buffer refused\n");
+    exit();
+  }
+  for(i = 0; i < 100; i++){
+    if(a[amt - 4096 + i] != 0){
+      printf(stdout, "lazy sbrk test: wrong data\n");
+      exit();
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(-amt);
+  printf(stdout, "lazy sbrk test OK\n");
+}
+
+// do 4MB heap pages hold their data, and split correctly
+// when a fork() shares them?
+void
+largepagetest(void)
+{
+  int pid, i;
+  char *a, *big;
+
+  printf(stdout, "large page test\n");
+  largepages(1);
+  a = sbrk(0);
+  big = (char*)(((uint)a + 2*4096*1024 - 1) & ~(4096*1024 - 1));
+  if(sbrk(big + 4096*1024 - a) == (char*)0xffffffff){
+    printf(stdout, "large page test sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < 4096*1024; i += 4096)
+    big[i] = i / 4096;
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "large page test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    for(i = 0; i < 4096*1024; i += 4096){
+      if(big[i] != (char)(i / 4096)){
+        printf(stdout, "large page test: child saw wrong data\n");
+        exit();
+      }
+      big[i] = 0;
+    }
+    exit();
+  }
+  wait();
+  for(i = 0; i < 4096*1024; i += 4096){
+    if(big[i] != (char)(i / 4096)){
+      printf(stdout, "large page test: parent saw wrong data\n");
+      exit();
+    }
+  }
+  sbrk(-(sbrk(0) - a));
+  largepages(0);
+  printf(stdout, "large page test OK\n");
+}
+
+// do attached processes share a segment, and does an id
+// stop working once its segment is gone?
+void
+shmtest(void)
+{
+  int id, id2, pid;
+  volatile int *p;
+
+  printf(stdout, "shm test\n");
+  id = shm_open(0x7e57, 4096);
+  if(id < 0 || (p = (int*)shm_attach(id)) == (int*)-1){
+    printf(stdout, "shm test open/attach failed\n");
+    exit();
+  }
+  *p = 1;
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "shm test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    *p = *p + 1;
+    exit();
+  }
+  wait();
+  if(*p != 2){
+    printf(stdout, "shm test: child's write not seen\n");
+    exit();
+  }
+  if(shm_open(0x7e57, 4096) != id){
+    printf(stdout, "shm test: key not found again\n");
+    exit();
+  }
+  shm_detach((void*)p);
+  if(shm_unlink(0x7e57) != 0 || shm_attach(id) != (char*)-1){
+    printf(stdout, "shm test: unlinked segment still attaches\n");
+    exit();
+  }
+
+  // a segment nobody attached outlives shm_open()
+  id2 = shm_open(0x7e58, 4096);
+  if(id2 < 0 || (p = (int*)shm_attach(id2)) == (int*)-1){
+    printf(stdout, "shm test: unattached segment lost\n");
+    exit();
+  }
+  shm_detach((void*)p);
+  shm_unlink(0x7e58);
+  printf(stdout, "shm test OK\n");
+}
+
+// does a file mapping read the file, and write the pages
+// it dirtied back on munmap()?
+void
+mmaptest(void)
+{
+  int fd, fds[2], i;
+  char *p;
+
+  printf(stdout, "mmap test\n");
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "mmap test create failed\n");
+    exit();
+  }
+  for(i = 0; i < 3*1024; i++)
+    buf[i] = 'a' + i % 26;
+  if(write(fd, buf, 3*1024) != 3*1024){
+    printf(stdout, "mmap test write failed\n");
+    exit();
+  }
+  p = mmap(fd, 0, 3*1024, PROT_READ|PROT_WRITE);
+  if(p == (char*)-1){
+    printf(stdout, "mmap test mmap failed\n");
+    exit();
+  }
+  for(i = 0; i < 3*1024; i++){
+    if(p[i] != 'a' + i % 26){
+      printf(stdout, "mmap test: wrong data mapped\n");
+      exit();
+    }
+  }
+  if(p[3*1024] != 0){
+    printf(stdout, "mmap test: past end of file not zero\n");
+    exit();
+  }
+  p[10] = 'X';
+  // write() may read from a mapping
+  if(pipe(fds) != 0 || write(fds[1], p, 100) != 100 ||
+     read(fds[0], buf, 100) != 100 || buf[10] != 'X'){
+    printf(stdout, "mmap test: write from mapping failed\n");
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  if(munmap(p, 3*1024) != 0){
+    printf(stdout, "mmap test munmap failed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("mmapfile", O_RDONLY);
+  if(fd < 0 || read(fd, buf, sizeof(buf)) != 3*1024){
+    printf(stdout, "mmap test reopen failed\n");
+    exit();
+  }
+  if(buf[10] != 'X' || buf[11] != 'a' + 11 % 26){
+    printf(stdout, "mmap test: dirty page not written back\n");
+    exit();
+  }
+  close(fd);
+  unlink("mmapfile");
+  printf(stdout, "mmap test OK\n");
+}
+
+// can the kernel read() into a large-page heap that no one
+// has touched yet?  Bringing the page in maps all 4MB at once.
+void
+largereadtest(void)
+{
+  int fds[2], i, n;
+  char *a, *big;
+
+  printf(stdout, "large page read test\n");
+  largepages(1);
+  a = sbrk(0);
+  if(sbrk(8*1024*1024) == (char*)0xffffffff){
+    printf(stdout, "large page read test sbrk failed\n");
+    exit();
+  }
+  big = (char*)(((uint)a + 4096*1024 - 1) & ~(4096*1024 - 1));
+  if(pipe(fds) != 0){
+    printf(stdout, "large page read test pipe failed\n");
+    exit();
+  }
+  for(i = 0; i < 4096; i++)
+    buf[i] = 'a' + i % 26;
+  if(fork() == 0){
+    write(fds[1], buf, 4096);
+    exit();
+  }
+  for(n = 0; n < 4096; n += i)
+    if((i = read(fds[0], big + 4096 + n, 4096 - n)) <= 0)
+      break;
+  wait();
+  if(n != 4096){
+    printf(stdout, "large page read test read failed\n");
+    exit();
+  }
+  for(i = 0; i < 4096; i++){
+    if(big[4096 + i] != 'a' + i % 26 || big[i] != 0){
+      printf(stdout, "large page read test: wrong data\n");
+      exit();
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(-(sbrk(0) - a));
+  largepages(0);
+  printf(stdout, "large page read test OK\n");
+}
+
+// when memory runs out, are a sleeping process's pages
+// swapped out, and read back intact, including into a
+// read() buffer?
+void
+swaptest(void)
+{
+  struct meminfo mi;
+  struct vmstat st;
+  int tochild[2], toparent[2], pid, i;
+  uint n, outs;
+  char *a, ok;
+
+  printf(stdout, "swap test\n");
+  if(vmstat(&st) < 0 || st.swapslots == 0){
+    printf(stdout, "swap test: no swap space\n");
+    exit();
+  }
+  outs = st.swapouts;
+  if(pipe(tochild) != 0 || pipe(toparent) != 0){
+    printf(stdout, "swap test pipe failed\n");
+    exit();
+  }
+  meminfo(&mi);
+  // leave the parent less than it will ask for
+  n = mi.free > 256 ? mi.free - 256 : 0;
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "swap test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(tochild[1]);
+    close(toparent[0]);
+    a = sbrk(n*4096);
+    if(a == (char*)0xffffffff)
+      exit();
+    for(i = 0; i < n; i++)
+      *(int*)(a + i*4096) = i;
+    write(toparent[1], "x", 1);
+    // the read() buffer is the first page, which the clock
+    // reaches first
+    ok = read(tochild[0], a + 8, 1) == 1 && a[8] == 'y';
+    for(i = 0; i < n; i++)
+      if(*(int*)(a + i*4096) != i)
+        ok = 0;
+    write(toparent[1], &ok, 1);
+    exit();
+  }
+  close(tochild[0]);
+  close(toparent[1]);
+  if(read(toparent[0], &ok, 1) != 1){
+    printf(stdout, "swap test: child could not allocate\n");
+    exit();
+  }
+  a = sbrk(512*4096);
+  if(a == (char*)0xffffffff){
+    printf(stdout, "swap test sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < 512; i++)
+    a[i*4096] = 1;
+  sbrk(-512*4096);
+  write(tochild[1], "y", 1);
+  if(read(toparent[0], &ok, 1) != 1 || !ok){
+    printf(stdout, "swap test: child's pages came back wrong\n");
+    exit();
+  }
+  wait();
+  vmstat(&st);
+  if(st.swapouts == outs){
+    printf(stdout, "swap test: nothing was swapped out\n");
+    exit();
+  }
+  close(tochild[1]);
+  close(toparent[0]);
+  printf(stdout, "swap test OK\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  printf(stdout, "vmtests starting\n");
+
+  cowtest();
+  lazysbrktest();
+  largepagetest();
+  shmtest();
+  mmaptest();
+  largereadtest();
+  swaptest();
+
+  printf(stdout, "ALL VM TESTS PASSED\n");
+  exit();
+}